@@ -0,0 +1,223 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#ifndef _disposer_module__async_queue__hpp_INCLUDED_
+#define _disposer_module__async_queue__hpp_INCLUDED_
+
+#include <condition_variable>
+#include <string_view>
+#include <stdexcept>
+#include <string>
+#include <array>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <mutex>
+#include <deque>
+#include <vector>
+
+
+namespace disposer_module{
+
+
+	enum class overflow_policy{
+		block,
+		drop_newest,
+		drop_oldest
+	};
+
+	constexpr std::array< std::string_view, 3 > overflow_policy_list{{
+			"block",
+			"drop_newest",
+			"drop_oldest"
+		}};
+
+	inline std::string to_string(overflow_policy const policy){
+		return std::string(
+			overflow_policy_list.at(static_cast< std::size_t >(policy)));
+	}
+
+
+	/// \brief Bounded queue processed by background threads
+	///
+	/// Exceptions of the process function are kept, the first one is
+	/// rethrown by rethrow_error(). The destructor processes all queued
+	/// items before it joins the threads.
+	template < typename T >
+	class async_queue{
+	public:
+		async_queue(
+			std::size_t thread_count,
+			std::size_t queue_size,
+			overflow_policy policy,
+			std::function< void(T&) > process
+		)
+			: async_queue(thread_count, queue_size, policy, 1,
+				[process = std::move(process)](std::vector< T >& items){
+					process(items.front());
+				}) {}
+
+		/// \brief Threads take up to max_batch queued items at once
+		async_queue(
+			std::size_t thread_count,
+			std::size_t queue_size,
+			overflow_policy policy,
+			std::size_t max_batch,
+			std::function< void(std::vector< T >&) > process
+		)
+			: queue_size_(queue_size)
+			, policy_(policy)
+			, max_batch_(max_batch)
+			, process_(std::move(process))
+		{
+			threads_.reserve(thread_count);
+			for(std::size_t i = 0; i < thread_count; ++i){
+				threads_.emplace_back([this]{ run(); });
+			}
+		}
+
+		async_queue(async_queue const&) = delete;
+
+		~async_queue(){
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				stop_ = true;
+			}
+			not_empty_.notify_all();
+
+			for(auto& thread: threads_){
+				thread.join();
+			}
+		}
+
+
+		/// \brief Enqueue an item, returns false if an item was dropped
+		bool push(T&& item){
+			bool result = true;
+			{
+				std::unique_lock< std::mutex > lock(mutex_);
+				if(queue_.size() >= queue_size_){
+					switch(policy_){
+						case overflow_policy::block:
+							not_full_.wait(lock, [this]{
+									return queue_.size() < queue_size_;
+								});
+						break;
+						case overflow_policy::drop_newest:
+							++dropped_;
+						return false;
+						case overflow_policy::drop_oldest:
+							queue_.pop_front();
+							++dropped_;
+							result = false;
+						break;
+					}
+				}
+
+				queue_.push_back(std::move(item));
+			}
+			not_empty_.notify_one();
+			return result;
+		}
+
+		/// \brief Wait until all queued items are processed
+		void flush(){
+			std::unique_lock< std::mutex > lock(mutex_);
+			idle_.wait(lock, [this]{
+					return queue_.empty() && active_ == 0;
+				});
+		}
+
+		void rethrow_error(){
+			std::exception_ptr error;
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				error = std::exchange(error_, nullptr);
+			}
+			if(error) std::rethrow_exception(error);
+		}
+
+		std::size_t size()const{
+			std::lock_guard< std::mutex > lock(mutex_);
+			return queue_.size();
+		}
+
+		std::size_t dropped()const{
+			std::lock_guard< std::mutex > lock(mutex_);
+			return dropped_;
+		}
+
+		std::size_t errors()const{
+			std::lock_guard< std::mutex > lock(mutex_);
+			return error_count_;
+		}
+
+
+	private:
+		void run(){
+			std::unique_lock< std::mutex > lock(mutex_);
+			for(;;){
+				not_empty_.wait(lock, [this]{
+						return !queue_.empty() || stop_;
+					});
+				if(queue_.empty()) return;
+
+				std::vector< T > items;
+				while(!queue_.empty() && items.size() < max_batch_){
+					items.push_back(std::move(queue_.front()));
+					queue_.pop_front();
+				}
+				++active_;
+				lock.unlock();
+				not_full_.notify_all();
+
+				std::exception_ptr error;
+				try{
+					process_(items);
+				}catch(...){
+					error = std::current_exception();
+				}
+
+				lock.lock();
+				--active_;
+				if(error){
+					++error_count_;
+					if(!error_) error_ = error;
+				}
+				if(queue_.empty() && active_ == 0){
+					idle_.notify_all();
+				}
+			}
+		}
+
+
+		std::size_t const queue_size_;
+		overflow_policy const policy_;
+		std::size_t const max_batch_;
+		std::function< void(std::vector< T >&) > const process_;
+
+		mutable std::mutex mutex_;
+		std::condition_variable not_empty_;
+		std::condition_variable not_full_;
+		std::condition_variable idle_;
+		std::deque< T > queue_;
+		std::size_t active_ = 0;
+		std::size_t dropped_ = 0;
+		std::size_t error_count_ = 0;
+		std::exception_ptr error_;
+		bool stop_ = false;
+
+		std::vector< std::thread > threads_;
+	};
+
+
+}
+
+
+#endif
@@ -0,0 +1,223 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#ifndef _disposer_module__compression__hpp_INCLUDED_
+#define _disposer_module__compression__hpp_INCLUDED_
+
+#include <string_view>
+#include <stdexcept>
+#include <optional>
+#include <memory>
+#include <string>
+#include <array>
+
+#include <lz4frame.h>
+#include <zstd.h>
+
+
+namespace disposer_module{
+
+
+	enum class compression{
+		none,
+		lz4,
+		zstd
+	};
+
+	constexpr std::array< std::string_view, 3 > compression_list{{
+			"none",
+			"lz4",
+			"zstd"
+		}};
+
+	inline std::string to_string(compression const codec){
+		return std::string(
+			compression_list.at(static_cast< std::size_t >(codec)));
+	}
+
+
+	/// \brief Compress data into one LZ4 or zstd frame
+	///
+	/// The frames are the same as written by the lz4 and zstd command line
+	/// tools, the content size is stored in the frame header.
+	inline std::string compress(
+		compression const codec,
+		std::optional< int > const level,
+		std::string const& data
+	){
+		switch(codec){
+			case compression::none:
+				return data;
+			case compression::lz4:{
+				LZ4F_preferences_t preferences{};
+				preferences.frameInfo.contentSize = data.size();
+				preferences.compressionLevel = level.value_or(0);
+
+				std::string result(
+					LZ4F_compressFrameBound(data.size(), &preferences), '\0');
+				auto const size = LZ4F_compressFrame(
+					result.data(), result.size(),
+					data.data(), data.size(), &preferences);
+				if(LZ4F_isError(size)){
+					throw std::runtime_error(
+						std::string("lz4 compression failed: ")
+						+ LZ4F_getErrorName(size));
+				}
+
+				result.resize(size);
+				return result;
+			}
+			case compression::zstd:{
+				std::string result(ZSTD_compressBound(data.size()), '\0');
+				auto const size = ZSTD_compress(
+					result.data(), result.size(),
+					data.data(), data.size(),
+					level.value_or(ZSTD_CLEVEL_DEFAULT));
+				if(ZSTD_isError(size)){
+					throw std::runtime_error(
+						std::string("zstd compression failed: ")
+						+ ZSTD_getErrorName(size));
+				}
+
+				result.resize(size);
+				return result;
+			}
+		}
+
+		throw std::logic_error("compression has unknown value");
+	}
+
+
+	inline std::string decompress_lz4(std::string const& data){
+		LZ4F_dctx* context = nullptr;
+		auto error = LZ4F_createDecompressionContext(&context, LZ4F_VERSION);
+		if(LZ4F_isError(error)){
+			throw std::runtime_error(
+				std::string("lz4 decompression failed: ")
+				+ LZ4F_getErrorName(error));
+		}
+		std::unique_ptr< LZ4F_dctx, decltype(&LZ4F_freeDecompressionContext) >
+			guard(context, &LZ4F_freeDecompressionContext);
+
+		LZ4F_frameInfo_t info{};
+		std::size_t in = data.size();
+		error = LZ4F_getFrameInfo(context, &info, data.data(), &in);
+		if(LZ4F_isError(error)){
+			throw std::runtime_error(
+				std::string("lz4 decompression failed: ")
+				+ LZ4F_getErrorName(error));
+		}
+
+		std::string result(info.contentSize > 0
+			? static_cast< std::size_t >(info.contentSize)
+			: data.size() * 4, '\0');
+		std::size_t out = 0;
+		for(;;){
+			if(out == result.size()){
+				result.resize(result.size() * 2 + 1);
+			}
+
+			std::size_t out_size = result.size() - out;
+			std::size_t in_size = data.size() - in;
+			auto const hint = LZ4F_decompress(context,
+				result.data() + out, &out_size,
+				data.data() + in, &in_size, nullptr);
+			if(LZ4F_isError(hint)){
+				throw std::runtime_error(
+					std::string("lz4 decompression failed: ")
+					+ LZ4F_getErrorName(hint));
+			}
+
+			out += out_size;
+			in += in_size;
+
+			if(hint == 0) break;
+
+			if(in == data.size() && out < result.size()){
+				throw std::runtime_error(
+					"lz4 decompression failed: frame is truncated");
+			}
+		}
+
+		result.resize(out);
+		return result;
+	}
+
+	inline std::string decompress_zstd(std::string const& data){
+		auto const content_size =
+			ZSTD_getFrameContentSize(data.data(), data.size());
+		if(content_size == ZSTD_CONTENTSIZE_ERROR){
+			throw std::runtime_error(
+				"zstd decompression failed: data is not a zstd frame");
+		}
+
+		if(content_size != ZSTD_CONTENTSIZE_UNKNOWN){
+			std::string result(static_cast< std::size_t >(content_size), '\0');
+			auto const size = ZSTD_decompress(result.data(), result.size(),
+				data.data(), data.size());
+			if(ZSTD_isError(size)){
+				throw std::runtime_error(
+					std::string("zstd decompression failed: ")
+					+ ZSTD_getErrorName(size));
+			}
+
+			result.resize(size);
+			return result;
+		}
+
+		std::unique_ptr< ZSTD_DCtx, decltype(&ZSTD_freeDCtx) >
+			context(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+		if(!context){
+			throw std::bad_alloc();
+		}
+
+		ZSTD_inBuffer in{data.data(), data.size(), 0};
+		std::string result(ZSTD_DStreamOutSize(), '\0');
+		std::size_t out_pos = 0;
+		for(;;){
+			ZSTD_outBuffer out{result.data(), result.size(), out_pos};
+			auto const hint = ZSTD_decompressStream(context.get(), &out, &in);
+			if(ZSTD_isError(hint)){
+				throw std::runtime_error(
+					std::string("zstd decompression failed: ")
+					+ ZSTD_getErrorName(hint));
+			}
+			out_pos = out.pos;
+
+			if(hint == 0) break;
+
+			if(out_pos == result.size()){
+				result.resize(result.size() * 2);
+			}else if(in.pos == in.size){
+				throw std::runtime_error(
+					"zstd decompression failed: frame is truncated");
+			}
+		}
+
+		result.resize(out_pos);
+		return result;
+	}
+
+	inline std::string decompress(
+		compression const codec,
+		std::string&& data
+	){
+		switch(codec){
+			case compression::none: return std::move(data);
+			case compression::lz4: return decompress_lz4(data);
+			case compression::zstd: return decompress_zstd(data);
+		}
+
+		throw std::logic_error("compression has unknown value");
+	}
+
+
+}
+
+
+#endif
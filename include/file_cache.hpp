@@ -0,0 +1,360 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#ifndef _disposer_module__file_cache__hpp_INCLUDED_
+#define _disposer_module__file_cache__hpp_INCLUDED_
+
+#include "file_descriptor.hpp"
+#include "xxhash64.hpp"
+
+#include <unordered_map>
+#include <string_view>
+#include <stdexcept>
+#include <optional>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <list>
+#include <ctime>
+#include <map>
+
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+namespace disposer_module{
+
+
+	/// \brief Format a time as HTTP-date (RFC 7231)
+	inline std::string http_date(std::time_t time){
+		std::tm tm{};
+		::gmtime_r(&time, &tm);
+		char buffer[32];
+		auto const size = std::strftime(buffer, sizeof(buffer),
+			"%a, %d %b %Y %H:%M:%S GMT", &tm);
+		return std::string(buffer, size);
+	}
+
+	/// \brief Parse an HTTP-date, empty if it has an other format
+	inline std::optional< std::time_t > parse_http_date(
+		std::string const& date
+	){
+		std::tm tm{};
+		auto const end = ::strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT",
+			&tm);
+		if(end == nullptr || *end != '\0') return {};
+		return ::timegm(&tm);
+	}
+
+
+	/// \brief Files of a directory tree in memory
+	///
+	/// Files are loaded on first request together with their .gz and .br
+	/// siblings. The least recently used files are dropped if the memory
+	/// budget is exceeded. An inotify thread drops files that change on
+	/// disk.
+	class file_cache{
+	public:
+		struct file{
+			std::string data;
+			std::string etag;
+		};
+
+		struct entry{
+			file identity;
+			std::optional< file > gzip;
+			std::optional< file > brotli;
+			std::time_t mtime;
+			std::string last_modified;
+
+			std::size_t size()const{
+				return identity.data.size()
+					+ (gzip ? gzip->data.size() : 0)
+					+ (brotli ? brotli->data.size() : 0);
+			}
+		};
+
+
+		file_cache(std::string root, std::size_t budget)
+			: root_(root.empty() || root.back() != '/'
+				? std::move(root) : root.substr(0, root.size() - 1))
+			, budget_(budget)
+			, inotify_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+			, stop_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+		{
+			if(inotify_.get() < 0){
+				throw std::runtime_error("inotify_init1 failed");
+			}
+			if(stop_.get() < 0){
+				throw std::runtime_error("eventfd failed");
+			}
+
+			thread_ = std::thread([this]{ watch(); });
+		}
+
+		file_cache(file_cache const&) = delete;
+
+		~file_cache(){
+			std::uint64_t const value = 1;
+			[[maybe_unused]] auto const written =
+				::write(stop_.get(), &value, sizeof(value));
+			thread_.join();
+		}
+
+
+		/// \brief The file of an URL path, nullptr if it is no regular
+		///        file in root or it is larger than the budget
+		///
+		/// Siblings that do not fit into the budget together with the file
+		/// are left out, so every loaded file is cached.
+		std::shared_ptr< entry const > get(std::string_view path){
+			if(!valid(path)) return nullptr;
+
+			std::string key(path);
+			std::uint64_t generation;
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				auto const iter = entries_.find(key);
+				if(iter != entries_.end()){
+					lru_.splice(lru_.begin(), lru_, iter->second.second);
+					++hits;
+					return iter->second.first;
+				}
+				generation = generation_;
+			}
+
+			++misses;
+			auto result = load(key);
+			if(!result) return nullptr;
+
+			auto const size = result->size();
+			std::lock_guard< std::mutex > lock(mutex_);
+			// a change while loading, the next request loads again
+			if(generation != generation_) return result;
+
+			auto const iter = entries_.find(key);
+			if(iter != entries_.end()) return iter->second.first;
+
+			lru_.push_front(key);
+			entries_.emplace(key, std::make_pair(result, lru_.begin()));
+			bytes_ += size;
+
+			while(bytes_ > budget_){
+				auto const last = entries_.find(lru_.back());
+				bytes_ -= last->second.first->size();
+				entries_.erase(last);
+				lru_.pop_back();
+			}
+
+			return result;
+		}
+
+		std::size_t bytes()const{
+			std::lock_guard< std::mutex > lock(mutex_);
+			return bytes_;
+		}
+
+
+		std::atomic< std::uint64_t > hits{0};
+		std::atomic< std::uint64_t > misses{0};
+
+
+	private:
+		/// \brief Absolute URL path without '..' and '.' segments
+		static bool valid(std::string_view path){
+			if(path.empty() || path[0] != '/') return false;
+			while(!path.empty()){
+				path.remove_prefix(1);
+				auto const segment = path.substr(0, path.find('/'));
+				if(segment == ".." || segment == ".") return false;
+				path.remove_prefix(segment.size());
+			}
+			return true;
+		}
+
+		static std::optional< file > read_file(
+			std::string const& filename,
+			std::size_t max_size,
+			struct stat& status
+		){
+			file_descriptor fd(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+			if(fd.get() < 0) return {};
+			if(
+				::fstat(fd.get(), &status) != 0 ||
+				!S_ISREG(status.st_mode) ||
+				static_cast< std::size_t >(status.st_size) > max_size
+			) return {};
+
+			file result;
+			result.data.resize(static_cast< std::size_t >(status.st_size));
+			std::size_t done = 0;
+			while(done < result.data.size()){
+				auto const count = ::read(fd.get(), result.data.data() + done,
+					result.data.size() - done);
+				if(count < 0){
+					if(errno == EINTR) continue;
+					return {};
+				}
+				if(count == 0) break;
+				done += static_cast< std::size_t >(count);
+			}
+			result.data.resize(done);
+
+			char etag[24];
+			std::snprintf(etag, sizeof(etag), "\"%016llx\"",
+				static_cast< unsigned long long >(xxhash64(result.data)));
+			result.etag = etag;
+			return result;
+		}
+
+		std::shared_ptr< entry const > load(std::string const& path){
+			auto const filename = root_ + path;
+
+			// watch before reading, a change after this is seen
+			add_watch(filename.substr(0, filename.rfind('/')));
+
+			struct stat status{};
+			auto identity = read_file(filename, budget_, status);
+			if(!identity) return nullptr;
+
+			auto result = std::make_shared< entry >();
+			result->identity = std::move(*identity);
+			result->mtime = status.st_mtime;
+			result->last_modified = http_date(status.st_mtime);
+
+			struct stat sibling{};
+			result->gzip = read_file(filename + ".gz",
+				budget_ - result->size(), sibling);
+			result->brotli = read_file(filename + ".br",
+				budget_ - result->size(), sibling);
+			return result;
+		}
+
+		void add_watch(std::string const& directory){
+			std::lock_guard< std::mutex > lock(mutex_);
+			for(auto const& [wd, name]: watches_){
+				if(name == directory) return;
+			}
+
+			auto const wd = ::inotify_add_watch(inotify_.get(),
+				directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB
+				| IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+				| IN_DELETE_SELF | IN_MOVE_SELF);
+			if(wd >= 0) watches_[wd] = directory;
+		}
+
+		/// \brief Drop a changed file, a sibling drops its original
+		void invalidate(std::string const& filename){
+			std::string_view path(filename);
+			if(path.substr(0, root_.size()) != root_) return;
+			path.remove_prefix(root_.size());
+			for(std::string_view suffix: {".gz", ".br"}){
+				if(
+					path.size() > suffix.size() &&
+					path.substr(path.size() - suffix.size()) == suffix
+				){
+					path.remove_suffix(suffix.size());
+				}
+			}
+
+			std::lock_guard< std::mutex > lock(mutex_);
+			++generation_;
+			auto const iter = entries_.find(std::string(path));
+			if(iter == entries_.end()) return;
+			bytes_ -= iter->second.first->size();
+			lru_.erase(iter->second.second);
+			entries_.erase(iter);
+		}
+
+		void clear(){
+			std::lock_guard< std::mutex > lock(mutex_);
+			++generation_;
+			entries_.clear();
+			lru_.clear();
+			bytes_ = 0;
+		}
+
+		void watch(){
+			alignas(inotify_event) char buffer[16 * 1024];
+			for(;;){
+				pollfd fds[2]{
+					{inotify_.get(), POLLIN, 0},
+					{stop_.get(), POLLIN, 0}
+				};
+				if(::poll(fds, 2, -1) < 0){
+					if(errno == EINTR) continue;
+					return;
+				}
+				if(fds[1].revents != 0) return;
+
+				auto const size =
+					::read(inotify_.get(), buffer, sizeof(buffer));
+				if(size <= 0) continue;
+
+				for(auto pos = buffer; pos < buffer + size;){
+					auto const& event =
+						*reinterpret_cast< inotify_event const* >(pos);
+					pos += sizeof(inotify_event) + event.len;
+
+					if(event.mask & IN_Q_OVERFLOW){
+						clear();
+						continue;
+					}
+
+					std::string directory;
+					{
+						std::lock_guard< std::mutex > lock(mutex_);
+						auto const iter = watches_.find(event.wd);
+						if(iter == watches_.end()) continue;
+						directory = iter->second;
+						if(event.mask & IN_IGNORED) watches_.erase(iter);
+					}
+
+					auto const gone =
+						IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED;
+					if(event.mask & gone){
+						// files of the directory are not watched anymore
+						clear();
+					}else if(event.len > 0){
+						invalidate(directory + "/" + event.name);
+					}
+				}
+			}
+		}
+
+
+		std::string const root_;
+		std::size_t const budget_;
+
+		mutable std::mutex mutex_;
+		std::list< std::string > lru_;
+		std::unordered_map< std::string, std::pair<
+			std::shared_ptr< entry const >,
+			std::list< std::string >::iterator > > entries_;
+		std::size_t bytes_ = 0;
+		std::uint64_t generation_ = 0;
+		std::map< int, std::string > watches_;
+
+		file_descriptor inotify_;
+		file_descriptor stop_;
+		std::thread thread_;
+	};
+
+
+}
+
+
+#endif
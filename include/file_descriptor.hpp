@@ -0,0 +1,58 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#ifndef _disposer_module__file_descriptor__hpp_INCLUDED_
+#define _disposer_module__file_descriptor__hpp_INCLUDED_
+
+#include <utility>
+
+#include <unistd.h>
+
+
+namespace disposer_module{
+
+
+	class file_descriptor{
+	public:
+		file_descriptor(int fd = -1)noexcept
+			: fd_(fd) {}
+
+		file_descriptor(file_descriptor&& other)noexcept
+			: fd_(std::exchange(other.fd_, -1)) {}
+
+		file_descriptor& operator=(file_descriptor&& other)noexcept{
+			reset(std::exchange(other.fd_, -1));
+			return *this;
+		}
+
+		~file_descriptor(){
+			reset();
+		}
+
+		int get()const noexcept{
+			return fd_;
+		}
+
+		int release()noexcept{
+			return std::exchange(fd_, -1);
+		}
+
+		void reset(int fd = -1)noexcept{
+			if(fd_ >= 0) ::close(fd_);
+			fd_ = fd;
+		}
+
+	private:
+		int fd_;
+	};
+
+
+}
+
+
+#endif
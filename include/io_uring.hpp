@@ -0,0 +1,366 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#ifndef _disposer_module__io_uring__hpp_INCLUDED_
+#define _disposer_module__io_uring__hpp_INCLUDED_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <system_error>
+#include <algorithm>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// openat, statx, read, write, close, fallocate and fadvise operations
+// exist since Linux 5.6, the header of that version is the minimum
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define DISPOSER_MODULE_HAS_IO_URING
+#endif
+
+
+namespace disposer_module{
+
+
+#ifdef DISPOSER_MODULE_HAS_IO_URING
+
+	/// \brief Minimal io_uring ring without liburing dependency
+	///
+	/// Operations are collected by the member functions and executed by
+	/// submit() as few io_uring_enter calls as the ring size allows. The
+	/// constructor throws std::system_error if the kernel can not create a
+	/// ring, callers are expected to fall back to the portable path then.
+	class io_uring{
+	public:
+		explicit io_uring(unsigned entries = 256){
+			::io_uring_params params{};
+			fd_ = static_cast< int >(
+				::syscall(__NR_io_uring_setup, entries, &params));
+			if(fd_ < 0){
+				throw std::system_error(errno, std::system_category(),
+					"io_uring_setup");
+			}
+
+			try{
+				sq_size_ = params.sq_off.array
+					+ params.sq_entries * sizeof(unsigned);
+				cq_size_ = params.cq_off.cqes
+					+ params.cq_entries * sizeof(::io_uring_cqe);
+				bool const single_mmap =
+					params.features & IORING_FEAT_SINGLE_MMAP;
+				if(single_mmap){
+					sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+				}
+
+				sq_ptr_ = map(sq_size_, IORING_OFF_SQ_RING);
+				cq_ptr_ = single_mmap
+					? sq_ptr_
+					: map(cq_size_, IORING_OFF_CQ_RING);
+				sqes_size_ = params.sq_entries * sizeof(::io_uring_sqe);
+				sqes_ = static_cast< ::io_uring_sqe* >(
+					map(sqes_size_, IORING_OFF_SQES));
+			}catch(...){
+				release();
+				throw;
+			}
+
+			auto const sq = static_cast< char* >(sq_ptr_);
+			sq_tail_ = reinterpret_cast< unsigned* >(sq + params.sq_off.tail);
+			sq_mask_ = *reinterpret_cast< unsigned* >(
+				sq + params.sq_off.ring_mask);
+			sq_array_ = reinterpret_cast< unsigned* >(
+				sq + params.sq_off.array);
+			sq_entries_ = params.sq_entries;
+
+			auto const cq = static_cast< char* >(cq_ptr_);
+			cq_head_ = reinterpret_cast< unsigned* >(cq + params.cq_off.head);
+			cq_tail_ = reinterpret_cast< unsigned* >(cq + params.cq_off.tail);
+			cq_mask_ = *reinterpret_cast< unsigned* >(
+				cq + params.cq_off.ring_mask);
+			cqes_ = reinterpret_cast< ::io_uring_cqe* >(
+				cq + params.cq_off.cqes);
+		}
+
+		io_uring(io_uring const&) = delete;
+		io_uring& operator=(io_uring const&) = delete;
+
+		~io_uring(){
+			release();
+		}
+
+
+		/// \brief Flag for the next operation to start after this one,
+		///        also if this one fails
+		static constexpr std::uint8_t link_next = IOSQE_IO_HARDLINK;
+
+
+		std::size_t openat(
+			int dirfd,
+			char const* path,
+			int flags,
+			mode_t mode = 0,
+			std::uint8_t sqe_flags = 0
+		){
+			auto& sqe = push(IORING_OP_OPENAT, dirfd, sqe_flags);
+			sqe.addr = reinterpret_cast< std::uintptr_t >(path);
+			sqe.len = mode;
+			sqe.open_flags = static_cast< std::uint32_t >(flags);
+			return pending_.size() - 1;
+		}
+
+		std::size_t statx(
+			int dirfd,
+			char const* path,
+			int flags,
+			unsigned mask,
+			struct ::statx* buffer,
+			std::uint8_t sqe_flags = 0
+		){
+			auto& sqe = push(IORING_OP_STATX, dirfd, sqe_flags);
+			sqe.addr = reinterpret_cast< std::uintptr_t >(path);
+			sqe.len = mask;
+			sqe.off = reinterpret_cast< std::uintptr_t >(buffer);
+			sqe.statx_flags = static_cast< std::uint32_t >(flags);
+			return pending_.size() - 1;
+		}
+
+		std::size_t read(
+			int fd,
+			void* buffer,
+			std::uint32_t size,
+			std::uint64_t offset,
+			std::uint8_t sqe_flags = 0
+		){
+			auto& sqe = push(IORING_OP_READ, fd, sqe_flags);
+			sqe.addr = reinterpret_cast< std::uintptr_t >(buffer);
+			sqe.len = size;
+			sqe.off = offset;
+			return pending_.size() - 1;
+		}
+
+		std::size_t write(
+			int fd,
+			void const* buffer,
+			std::uint32_t size,
+			std::uint64_t offset,
+			std::uint8_t sqe_flags = 0
+		){
+			auto& sqe = push(IORING_OP_WRITE, fd, sqe_flags);
+			sqe.addr = reinterpret_cast< std::uintptr_t >(buffer);
+			sqe.len = size;
+			sqe.off = offset;
+			return pending_.size() - 1;
+		}
+
+		std::size_t fallocate(
+			int fd,
+			int mode,
+			std::uint64_t offset,
+			std::uint64_t size,
+			std::uint8_t sqe_flags = 0
+		){
+			auto& sqe = push(IORING_OP_FALLOCATE, fd, sqe_flags);
+			sqe.addr = size;
+			sqe.len = static_cast< std::uint32_t >(mode);
+			sqe.off = offset;
+			return pending_.size() - 1;
+		}
+
+		std::size_t fadvise(
+			int fd,
+			std::uint64_t offset,
+			std::uint32_t size,
+			int advice,
+			std::uint8_t sqe_flags = 0
+		){
+			auto& sqe = push(IORING_OP_FADVISE, fd, sqe_flags);
+			sqe.len = size;
+			sqe.off = offset;
+			sqe.fadvise_advice = static_cast< std::uint32_t >(advice);
+			return pending_.size() - 1;
+		}
+
+		std::size_t close(int fd, std::uint8_t sqe_flags = 0){
+			push(IORING_OP_CLOSE, fd, sqe_flags);
+			return pending_.size() - 1;
+		}
+
+
+		/// \brief Execute all collected operations and wait for them
+		///
+		/// The operations of one submit() call are not ordered, except an
+		/// operation collected with link_next, its successor starts after it
+		/// completed. The result at the index returned by the collecting
+		/// function is the syscall return value or the negative errno.
+		std::vector< std::int32_t > submit(){
+			auto ops = std::move(pending_);
+			pending_.clear();
+
+			std::vector< std::int32_t > result(ops.size());
+			for(std::size_t first = 0; first < ops.size();){
+				auto count = static_cast< unsigned >(
+					std::min< std::size_t >(sq_entries_, ops.size() - first));
+
+				// a link chain must not end at the border of a batch
+				while(
+					first + count < ops.size() && count > 1 &&
+					(ops[first + count - 1].flags & link_next)
+				) --count;
+
+				unsigned tail = *sq_tail_;
+				for(unsigned i = 0; i < count; ++i, ++tail){
+					auto const index = tail & sq_mask_;
+					sqes_[index] = ops[first + i];
+					sqes_[index].user_data = first + i;
+					sq_array_[index] = index;
+				}
+				__atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+				for(unsigned submitted = 0, completed = 0; completed < count;){
+					auto const ret = ::syscall(__NR_io_uring_enter, fd_,
+						count - submitted, 1u, IORING_ENTER_GETEVENTS,
+						nullptr, 0);
+					if(ret < 0){
+						if(errno == EINTR || errno == EAGAIN) continue;
+						throw std::system_error(errno, std::system_category(),
+							"io_uring_enter");
+					}
+					submitted += static_cast< unsigned >(ret);
+
+					unsigned head = *cq_head_;
+					unsigned const cq_tail =
+						__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+					for(; head != cq_tail; ++head, ++completed){
+						auto const& cqe = cqes_[head & cq_mask_];
+						result[cqe.user_data] = cqe.res;
+					}
+					__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+				}
+
+				first += count;
+			}
+
+			return result;
+		}
+
+
+	private:
+		void* map(std::size_t size, std::uint64_t offset){
+			auto const ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd_, static_cast< off_t >(offset));
+			if(ptr == MAP_FAILED){
+				throw std::system_error(errno, std::system_category(),
+					"io_uring mmap");
+			}
+			return ptr;
+		}
+
+		void release()noexcept{
+			if(sqes_) ::munmap(sqes_, sqes_size_);
+			if(cq_ptr_ && cq_ptr_ != sq_ptr_) ::munmap(cq_ptr_, cq_size_);
+			if(sq_ptr_) ::munmap(sq_ptr_, sq_size_);
+			::close(fd_);
+		}
+
+		::io_uring_sqe& push(std::uint8_t opcode, int fd, std::uint8_t flags){
+			auto& sqe = pending_.emplace_back();
+			sqe.opcode = opcode;
+			sqe.fd = fd;
+			sqe.flags = flags;
+			return sqe;
+		}
+
+
+		int fd_ = -1;
+
+		void* sq_ptr_ = nullptr;
+		void* cq_ptr_ = nullptr;
+		::io_uring_sqe* sqes_ = nullptr;
+		std::size_t sq_size_ = 0;
+		std::size_t cq_size_ = 0;
+		std::size_t sqes_size_ = 0;
+
+		unsigned* sq_tail_ = nullptr;
+		unsigned* sq_array_ = nullptr;
+		unsigned sq_mask_ = 0;
+		unsigned sq_entries_ = 0;
+
+		unsigned* cq_head_ = nullptr;
+		unsigned* cq_tail_ = nullptr;
+		unsigned cq_mask_ = 0;
+		::io_uring_cqe* cqes_ = nullptr;
+
+		std::vector< ::io_uring_sqe > pending_;
+	};
+
+#else
+
+	class io_uring{
+	public:
+		explicit io_uring(unsigned = 256){
+			throw std::system_error(ENOSYS, std::system_category(),
+				"io_uring is not available in this build");
+		}
+
+		io_uring(io_uring const&) = delete;
+		io_uring& operator=(io_uring const&) = delete;
+
+		static constexpr std::uint8_t link_next = 0;
+
+		std::size_t openat(int, char const*, int, mode_t = 0,
+			std::uint8_t = 0
+		){
+			return 0;
+		}
+		std::size_t statx(int, char const*, int, unsigned, struct ::statx*,
+			std::uint8_t = 0
+		){
+			return 0;
+		}
+		std::size_t read(int, void*, std::uint32_t, std::uint64_t,
+			std::uint8_t = 0
+		){
+			return 0;
+		}
+		std::size_t write(int, void const*, std::uint32_t, std::uint64_t,
+			std::uint8_t = 0
+		){
+			return 0;
+		}
+		std::size_t fallocate(int, int, std::uint64_t, std::uint64_t,
+			std::uint8_t = 0
+		){
+			return 0;
+		}
+		std::size_t fadvise(int, std::uint64_t, std::uint32_t, int,
+			std::uint8_t = 0
+		){
+			return 0;
+		}
+		std::size_t close(int, std::uint8_t = 0){ return 0; }
+
+		std::vector< std::int32_t > submit(){ return {}; }
+	};
+
+#endif
+
+
+}
+
+
+#endif
@@ -0,0 +1,44 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#ifndef _disposer_module__parse_enum__hpp_INCLUDED_
+#define _disposer_module__parse_enum__hpp_INCLUDED_
+
+#include <io_tools/range_to_string.hpp>
+
+#include <string_view>
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+#include <array>
+
+
+namespace disposer_module{
+
+
+	/// \brief The enum value at the position of data in list
+	template < typename Enum, std::size_t N >
+	Enum parse_enum(
+		std::string_view data,
+		std::array< std::string_view, N > const& list
+	){
+		auto iter = std::find(list.begin(), list.end(), data);
+		if(iter == list.end()){
+			throw std::runtime_error("unknown value '"
+				+ std::string(data)
+				+ "', valid values are: "
+				+ io_tools::range_to_string(list));
+		}
+		return static_cast< Enum >(iter - list.begin());
+	}
+
+
+}
+
+
+#endif
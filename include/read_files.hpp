@@ -0,0 +1,360 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#ifndef _disposer_module__read_files__hpp_INCLUDED_
+#define _disposer_module__read_files__hpp_INCLUDED_
+
+#include "compression.hpp"
+#include "file_descriptor.hpp"
+#include "io_uring.hpp"
+#include "parse_enum.hpp"
+
+#include <io_tools/range_to_string.hpp>
+
+#include <logsys/stdlogb.hpp>
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace disposer_module{
+
+
+	inline void verify_stream(std::ifstream& is, std::string const& filename){
+		if(is) return;
+		throw std::runtime_error("Can not read file '" + filename + "'");
+	}
+
+	inline std::string read_file(std::string const& filename){
+		std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+		verify_stream(is, filename);
+		return std::string(
+			std::istreambuf_iterator<char>(is),
+			std::istreambuf_iterator<char>());
+	}
+
+
+	enum class cache_mode{
+		cached,
+		streaming,
+		direct
+	};
+
+	constexpr std::array< std::string_view, 3 > cache_mode_list{{
+			"cached",
+			"streaming",
+			"direct"
+		}};
+
+	inline std::string to_string(cache_mode const mode){
+		return std::string(
+			cache_mode_list.at(static_cast< std::size_t >(mode)));
+	}
+
+	constexpr char const* cache_mode_description =
+		"page cache usage of the reads:\n"
+		"* cached => normal reads, the files stay in the page cache\n"
+		"* streaming => sequential read-ahead, the pages of a file are "
+		"dropped from the page cache after it was read, use this to replay "
+		"large data sets once without evicting other files\n"
+		"* direct => O_DIRECT reads into aligned buffers, bypasses the page "
+		"cache, falls back to streaming if the file system does not support "
+		"O_DIRECT, the io_uring backend handles it like streaming";
+
+	inline std::size_t file_size(int fd, std::string const& filename){
+		struct ::stat stat;
+		if(::fstat(fd, &stat) < 0){
+			throw std::runtime_error("Can not read file '" + filename + "'");
+		}
+		return static_cast< std::size_t >(stat.st_size);
+	}
+
+	inline std::string read_file_streaming(std::string const& filename){
+		file_descriptor fd(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+		if(fd.get() < 0){
+			throw std::runtime_error("Can not read file '" + filename + "'");
+		}
+
+		::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		std::string result(file_size(fd.get(), filename), '\0');
+		std::size_t done = 0;
+		while(done < result.size()){
+			auto const size = ::read(fd.get(), result.data() + done,
+				result.size() - done);
+			if(size < 0){
+				if(errno == EINTR) continue;
+				throw std::runtime_error("Can not read file '" + filename
+					+ "'");
+			}
+			if(size == 0){
+				result.resize(done);
+				break;
+			}
+			done += static_cast< std::size_t >(size);
+		}
+
+		::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_DONTNEED);
+		return result;
+	}
+
+	inline std::string read_file_direct(std::string const& filename){
+		// logical block size of all common devices divides the page size
+		constexpr std::size_t alignment = 4096;
+
+		file_descriptor fd(
+			::open(filename.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT));
+		if(fd.get() < 0){
+			if(errno == EINVAL) return read_file_streaming(filename);
+			throw std::runtime_error("Can not read file '" + filename + "'");
+		}
+
+		auto const size = file_size(fd.get(), filename);
+		auto const capacity = (size / alignment + 1) * alignment;
+		std::unique_ptr< char, decltype(&std::free) > buffer(
+			static_cast< char* >(std::aligned_alloc(alignment, capacity)),
+			&std::free);
+		if(!buffer){
+			throw std::bad_alloc();
+		}
+
+		std::size_t done = 0;
+		for(;;){
+			auto const count = ::read(fd.get(), buffer.get() + done,
+				capacity - done);
+			if(count < 0){
+				if(errno == EINTR) continue;
+				if(errno == EINVAL && done == 0){
+					return read_file_streaming(filename);
+				}
+				throw std::runtime_error("Can not read file '" + filename
+					+ "'");
+			}
+			done += static_cast< std::size_t >(count);
+			if(count == 0 || done % alignment != 0 || done == capacity){
+				break;
+			}
+		}
+
+		return std::string(buffer.get(), std::min(done, size));
+	}
+
+	inline std::string read_file(
+		std::string const& filename,
+		cache_mode mode
+	){
+		switch(mode){
+			case cache_mode::cached: return read_file(filename);
+			case cache_mode::streaming: return read_file_streaming(filename);
+			case cache_mode::direct: return read_file_direct(filename);
+		}
+		throw std::logic_error("unknown cache_mode");
+	}
+
+
+	inline std::vector< std::string > read_files(
+		io_uring& ring,
+		std::vector< std::string > const& filenames,
+		cache_mode mode
+	){
+		// a single io_uring read is limited like read(2)
+		constexpr std::size_t max_read_size = std::size_t(1) << 30;
+
+		auto const count = filenames.size();
+		std::vector< struct ::statx > stats(count);
+		for(std::size_t i = 0; i < count; ++i){
+			ring.openat(AT_FDCWD, filenames[i].c_str(), O_RDONLY | O_CLOEXEC);
+			ring.statx(AT_FDCWD, filenames[i].c_str(), 0, STATX_SIZE,
+				&stats[i]);
+		}
+		auto const opened = ring.submit();
+
+		// the operations of one submit are unordered, so every advice
+		// needs its own batch
+		auto const advise_all = [&ring, &opened, count](int advice){
+			for(std::size_t i = 0; i < count; ++i){
+				if(opened[i * 2] < 0) continue;
+				ring.fadvise(opened[i * 2], 0, 0, advice);
+			}
+			ring.submit();
+		};
+
+		auto const close_all = [&ring, &opened, count, mode, &advise_all]{
+			if(mode != cache_mode::cached){
+				advise_all(POSIX_FADV_DONTNEED);
+			}
+
+			for(std::size_t i = 0; i < count; ++i){
+				if(opened[i * 2] >= 0) ring.close(opened[i * 2]);
+			}
+			ring.submit();
+		};
+
+		for(std::size_t i = 0; i < count; ++i){
+			if(opened[i * 2] >= 0 && opened[i * 2 + 1] >= 0) continue;
+			close_all();
+			throw std::runtime_error("Can not read file '" + filenames[i]
+				+ "'");
+		}
+
+		if(mode != cache_mode::cached){
+			advise_all(POSIX_FADV_SEQUENTIAL);
+		}
+
+		std::vector< std::string > result(count);
+		std::vector< std::size_t > done(count, 0);
+		std::vector< std::size_t > pending;
+		pending.reserve(count);
+		for(std::size_t i = 0; i < count; ++i){
+			result[i].resize(stats[i].stx_size);
+			if(!result[i].empty()) pending.push_back(i);
+		}
+
+		// reads can be short, repeat them until all files are complete
+		while(!pending.empty()){
+			for(auto const i: pending){
+				auto const size = std::min(
+					result[i].size() - done[i], max_read_size);
+				ring.read(opened[i * 2], result[i].data() + done[i],
+					static_cast< std::uint32_t >(size), done[i]);
+			}
+			auto const read = ring.submit();
+
+			std::vector< std::size_t > next;
+			for(std::size_t k = 0; k < pending.size(); ++k){
+				auto const i = pending[k];
+				if(read[k] < 0){
+					close_all();
+					throw std::runtime_error("Can not read file '"
+						+ filenames[i] + "'");
+				}
+
+				if(read[k] == 0){
+					// file was truncated after statx
+					result[i].resize(done[i]);
+					continue;
+				}
+
+				done[i] += static_cast< std::size_t >(read[k]);
+				if(done[i] < result[i].size()) next.push_back(i);
+			}
+			pending = std::move(next);
+		}
+
+		close_all();
+		return result;
+	}
+
+
+	enum class read_backend{
+		iostream,
+		io_uring
+	};
+
+	constexpr std::array< std::string_view, 2 > read_backend_list{{
+			"iostream",
+			"io_uring"
+		}};
+
+	inline std::string to_string(read_backend const backend){
+		return std::string(
+			read_backend_list.at(static_cast< std::size_t >(backend)));
+	}
+
+	constexpr char const* read_backend_description =
+		"how files are read:\n"
+		"* iostream => open and read every file on its own\n"
+		"* io_uring => submit the opens and reads of all files of an exec "
+		"as one batch, falls back to iostream if the kernel does not "
+		"support io_uring";
+
+
+	struct read_state{
+		cache_mode const mode;
+		compression const codec;
+		std::unique_ptr< io_uring > ring;
+		std::mutex mutex;
+	};
+
+	template < typename Module >
+	std::unique_ptr< read_state > make_read_state(
+		Module const module,
+		read_backend backend,
+		cache_mode mode,
+		compression codec
+	){
+		std::unique_ptr< read_state > result(
+			new read_state{mode, codec, {}, {}});
+		if(backend == read_backend::io_uring){
+			module.exception_catching_log(
+				[](logsys::stdlogb& os){
+					os << "create io_uring, use iostream on failure";
+				}, [&result]{
+					result->ring = std::make_unique< io_uring >();
+				});
+		}
+		return result;
+	}
+
+	template < typename Module >
+	std::vector< std::string > read_files(
+		Module const module,
+		read_state& state,
+		std::vector< std::string > const& filenames
+	){
+		if(state.ring){
+			auto result = module.log([&filenames](logsys::stdlogb& os){
+					os << "io_uring read "
+						<< io_tools::range_to_string(filenames);
+				}, [&state, &filenames]{
+					std::lock_guard< std::mutex > lock(state.mutex);
+					return read_files(*state.ring, filenames, state.mode);
+				});
+
+			if(state.codec != compression::none){
+				module.log([&state](logsys::stdlogb& os){
+						os << "decompress " << to_string(state.codec);
+					}, [&state, &result]{
+						for(auto& data: result){
+							data = decompress(state.codec, std::move(data));
+						}
+					});
+			}
+
+			return result;
+		}
+
+		std::vector< std::string > result;
+		result.reserve(filenames.size());
+		for(auto const& filename: filenames){
+			result.push_back(module.log([&filename](logsys::stdlogb& os){
+					os << filename;
+				}, [&state, &filename]{
+					return decompress(state.codec,
+						read_file(filename, state.mode));
+				}));
+		}
+		return result;
+	}
+
+
+}
+
+
+#endif
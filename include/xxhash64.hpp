@@ -0,0 +1,119 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#ifndef _disposer_module__xxhash64__hpp_INCLUDED_
+#define _disposer_module__xxhash64__hpp_INCLUDED_
+
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+
+namespace disposer_module{
+
+
+	namespace detail::xxhash64{
+
+
+		constexpr std::uint64_t p1 = 11400714785074694791ull;
+		constexpr std::uint64_t p2 = 14029467366897019727ull;
+		constexpr std::uint64_t p3 = 1609587929392839161ull;
+		constexpr std::uint64_t p4 = 9650029242287828579ull;
+		constexpr std::uint64_t p5 = 2870177450012600261ull;
+
+		constexpr std::uint64_t rotl(std::uint64_t value, int bits){
+			return (value << bits) | (value >> (64 - bits));
+		}
+
+		constexpr std::uint64_t round(std::uint64_t acc, std::uint64_t input){
+			return rotl(acc + input * p2, 31) * p1;
+		}
+
+		constexpr std::uint64_t merge(std::uint64_t acc, std::uint64_t value){
+			return (acc ^ round(0, value)) * p1 + p4;
+		}
+
+		// little endian reads, like the reference implementation on x86
+		inline std::uint64_t read64(char const* data){
+			std::uint64_t result;
+			std::memcpy(&result, data, sizeof(result));
+			return result;
+		}
+
+		inline std::uint32_t read32(char const* data){
+			std::uint32_t result;
+			std::memcpy(&result, data, sizeof(result));
+			return result;
+		}
+
+
+	}
+
+
+	/// \brief xxHash64 of data, a fast non-cryptographic hash
+	inline std::uint64_t xxhash64(
+		std::string_view data,
+		std::uint64_t seed = 0
+	){
+		using namespace detail::xxhash64;
+
+		auto pos = data.data();
+		auto const end = pos + data.size();
+
+		std::uint64_t hash;
+		if(data.size() >= 32){
+			std::uint64_t v1 = seed + p1 + p2;
+			std::uint64_t v2 = seed + p2;
+			std::uint64_t v3 = seed;
+			std::uint64_t v4 = seed - p1;
+
+			for(; end - pos >= 32; pos += 32){
+				v1 = round(v1, read64(pos));
+				v2 = round(v2, read64(pos + 8));
+				v3 = round(v3, read64(pos + 16));
+				v4 = round(v4, read64(pos + 24));
+			}
+
+			hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+			hash = merge(hash, v1);
+			hash = merge(hash, v2);
+			hash = merge(hash, v3);
+			hash = merge(hash, v4);
+		}else{
+			hash = seed + p5;
+		}
+
+		hash += data.size();
+
+		for(; end - pos >= 8; pos += 8){
+			hash = rotl(hash ^ round(0, read64(pos)), 27) * p1 + p4;
+		}
+
+		if(end - pos >= 4){
+			hash = rotl(hash ^ (read32(pos) * p1), 23) * p2 + p3;
+			pos += 4;
+		}
+
+		for(; pos < end; ++pos){
+			hash = rotl(hash ^ (static_cast< unsigned char >(*pos) * p5), 11)
+				* p1;
+		}
+
+		hash ^= hash >> 33;
+		hash *= p2;
+		hash ^= hash >> 29;
+		hash *= p3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+
+}
+
+
+#endif
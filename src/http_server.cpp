@@ -6,6 +6,13 @@
 // Distributed under the Boost Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
 //-----------------------------------------------------------------------------
+#include "file_cache.hpp"
+#include "parse_enum.hpp"
+#include "xxhash64.hpp"
+
+#include <bitmap/bitmap.hpp>
+#include <bitmap/pixel.hpp>
+
 #include <disposer/component.hpp>
 #include <disposer/module.hpp>
 #include <disposer/core/enabled_chain.hpp>
@@ -17,11 +24,27 @@
 #include <webservice/ws_service_handler.hpp>
 #include <webservice/file_request_handler.hpp>
 
+#include <boost/beast/http.hpp>
+
 #include <boost/dll.hpp>
 
+#include <condition_variable>
 #include <shared_mutex>
 #include <thread>
+#include <functional>
+#include <charconv>
+#include <numeric>
+#include <sstream>
 #include <chrono>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <map>
+
+#include <turbojpeg.h>
+#include <zlib.h>
 
 
 namespace disposer_module::http_server_component{
@@ -42,19 +65,636 @@ namespace disposer_module::http_server_component{
 	}
 
 
+	enum class schedule_policy{
+		catch_up,
+		skip
+	};
+
+	constexpr std::array< std::string_view, 2 > schedule_policy_list{{
+			"catch_up",
+			"skip"
+		}};
+
+	std::string to_string(schedule_policy const policy){
+		return std::string(
+			schedule_policy_list.at(static_cast< std::size_t >(policy)));
+	}
+
+	/// \brief Upper limit of live chain intervals (one hour)
+	constexpr std::uint32_t max_interval_in_ms = 60 * 60 * 1000;
+
+
+	/// \brief Prometheus histogram with fixed buckets in seconds
+	class histogram{
+	public:
+		static constexpr std::array< double, 13 > bounds{{
+				0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+				0.25, 0.5, 1, 2.5, 5, 10
+			}};
+
+		void observe(std::chrono::nanoseconds duration){
+			std::chrono::duration< double > const seconds = duration;
+			auto const iter = std::lower_bound(
+				bounds.begin(), bounds.end(), seconds.count());
+			++buckets_[iter - bounds.begin()];
+			sum_ns_ += static_cast< std::uint64_t >(duration.count());
+		}
+
+		void write(
+			std::ostream& os,
+			std::string const& name,
+			std::string const& labels
+		)const{
+			std::uint64_t count = 0;
+			for(std::size_t i = 0; i < buckets_.size(); ++i){
+				count += buckets_[i];
+				os << name << "_bucket{" << labels << ",le=\"";
+				if(i < bounds.size()){
+					os << bounds[i];
+				}else{
+					os << "+Inf";
+				}
+				os << "\"} " << count << '\n';
+			}
+			os << name << "_sum{" << labels << "} " << sum_ns_ * 1e-9 << '\n';
+			os << name << "_count{" << labels << "} " << count << '\n';
+		}
+
+	private:
+		std::array< std::atomic< std::uint64_t >, bounds.size() + 1 >
+			buckets_{};
+		std::atomic< std::uint64_t > sum_ns_{0};
+	};
+
+	struct chain_metrics{
+		std::atomic< std::uint64_t > execs{0};
+		std::atomic< std::uint64_t > errors{0};
+		histogram exec_seconds;
+	};
+
+	struct live_metrics{
+		std::atomic< std::int64_t > sessions{0};
+		std::atomic< std::uint64_t > frames_sent{0};
+		std::atomic< std::uint64_t > bytes_sent{0};
+		std::atomic< std::uint64_t > frames_skipped{0};
+		std::atomic< std::uint64_t > errors{0};
+	};
+
+
+	/// \brief Counters of the server in the Prometheus text format
+	///
+	/// All values are atomics. The mutex only guards adding chains and
+	/// services, so a scrape never waits for a strand or an exec.
+	class metrics{
+	public:
+		explicit metrics(std::size_t threads)
+			: threads_(threads) {}
+
+		chain_metrics& chain(std::string const& name){
+			return get(chains_, name);
+		}
+
+		live_metrics& live(std::string const& name){
+			return get(lives_, name);
+		}
+
+		std::string text()const{
+			std::ostringstream os;
+			os << "# TYPE http_server_threads gauge\n"
+				<< "http_server_threads " << threads_ << '\n'
+				<< "# TYPE http_server_chains_running gauge\n"
+				<< "http_server_chains_running " << chains_running << '\n'
+				<< "# TYPE http_server_chain_execs_running gauge\n"
+				<< "http_server_chain_execs_running " << execs_running
+				<< '\n';
+
+			std::shared_lock< std::shared_mutex > lock(mutex_);
+			os << "# TYPE http_server_chain_execs_total counter\n";
+			for(auto const& [name, chain]: chains_){
+				os << "http_server_chain_execs_total{" << label("chain", name)
+					<< "} " << chain->execs << '\n';
+			}
+			os << "# TYPE http_server_chain_errors_total counter\n";
+			for(auto const& [name, chain]: chains_){
+				os << "http_server_chain_errors_total{"
+					<< label("chain", name) << "} " << chain->errors << '\n';
+			}
+			os << "# TYPE http_server_chain_exec_seconds histogram\n";
+			for(auto const& [name, chain]: chains_){
+				chain->exec_seconds.write(os,
+					"http_server_chain_exec_seconds", label("chain", name));
+			}
+
+			write_live(os, "sessions", "gauge", &live_metrics::sessions);
+			write_live(os, "frames_sent_total", "counter",
+				&live_metrics::frames_sent);
+			write_live(os, "bytes_sent_total", "counter",
+				&live_metrics::bytes_sent);
+			write_live(os, "frames_skipped_total", "counter",
+				&live_metrics::frames_skipped);
+
+			os << "# TYPE http_server_websocket_errors_total counter\n"
+				<< "http_server_websocket_errors_total{service=\"/\"} "
+				<< control_errors << '\n';
+			for(auto const& [name, live]: lives_){
+				os << "http_server_websocket_errors_total{"
+					<< label("service", name) << "} " << live->errors << '\n';
+			}
+
+			return os.str();
+		}
+
+		std::atomic< std::int64_t > chains_running{0};
+		std::atomic< std::int64_t > execs_running{0};
+		std::atomic< std::uint64_t > control_errors{0};
+
+
+	private:
+		template < typename T >
+		T& get(
+			std::map< std::string, std::unique_ptr< T > >& map,
+			std::string const& name
+		){
+			{
+				std::shared_lock< std::shared_mutex > lock(mutex_);
+				auto const iter = map.find(name);
+				if(iter != map.end()) return *iter->second;
+			}
+
+			// only a new name locks exclusively
+			std::lock_guard< std::shared_mutex > lock(mutex_);
+			auto& result = map[name];
+			if(!result) result = std::make_unique< T >();
+			return *result;
+		}
+
+		template < typename T >
+		void write_live(
+			std::ostream& os,
+			std::string const& name,
+			char const* type,
+			T live_metrics::* member
+		)const{
+			os << "# TYPE http_server_live_" << name << ' ' << type << '\n';
+			for(auto const& [service, live]: lives_){
+				os << "http_server_live_" << name << '{'
+					<< label("service", service) << "} " << (*live).*member
+					<< '\n';
+			}
+		}
+
+		static std::string label(char const* key, std::string const& value){
+			std::string result = key;
+			result += "=\"";
+			for(auto const c: value){
+				if(c == '\\' || c == '"'){
+					result += '\\';
+					result += c;
+				}else if(c == '\n'){
+					result += "\\n";
+				}else{
+					result += c;
+				}
+			}
+			result += '"';
+			return result;
+		}
+
+
+		std::size_t const threads_;
+
+		mutable std::shared_mutex mutex_;
+		std::map< std::string, std::unique_ptr< chain_metrics > > chains_;
+		std::map< std::string, std::unique_ptr< live_metrics > > lives_;
+	};
+
+
+	/// \brief zlib stream of data as read by DecompressionStream('deflate')
+	std::string deflate(std::string const& data, int level){
+		auto size = compressBound(data.size());
+		std::string result(size, '\0');
+		auto const error = compress2(
+			reinterpret_cast< Bytef* >(result.data()), &size,
+			reinterpret_cast< Bytef const* >(data.data()), data.size(),
+			level);
+		if(error != Z_OK){
+			throw std::runtime_error(
+				std::string("deflate failed: ") + zError(error));
+		}
+
+		result.resize(size);
+		return result;
+	}
+
+
+	bool is_jpg(std::string const& data){
+		return data.size() > 2 && data[0] == '\xFF' && data[1] == '\xD8';
+	}
+
+	/// \brief Decode a JPEG scaled by the largest DCT scaling factor that
+	///        fits into max_width and encode it with quality
+	///
+	/// A max_width of 0 keeps the size, a quality of 0 uses 90.
+	std::string transcode_jpg(
+		std::string const& data,
+		std::size_t max_width,
+		int quality
+	){
+		auto const deleter = [](void* handle){ tjDestroy(handle); };
+		std::unique_ptr< void, decltype(deleter) > decompressor(
+			tjInitDecompress(), deleter);
+		if(!decompressor) throw std::runtime_error("tjInitDecompress failed");
+
+		auto const jpg = const_cast< unsigned char* >(
+			reinterpret_cast< unsigned char const* >(data.data()));
+		int width = 0;
+		int height = 0;
+		int subsampling = 0;
+		int colorspace = 0;
+		if(tjDecompressHeader3(decompressor.get(), jpg, data.size(),
+			&width, &height, &subsampling, &colorspace) != 0
+		) throw std::runtime_error("tjDecompressHeader3 failed");
+
+		int scaled_width = width;
+		int scaled_height = height;
+		if(max_width > 0){
+			int count = 0;
+			auto const factors = tjGetScalingFactors(&count);
+			if(!factors) throw std::runtime_error("tjGetScalingFactors failed");
+
+			// the smallest size if no factor fits
+			std::optional< tjscalingfactor > fit;
+			std::optional< tjscalingfactor > smallest;
+			for(int i = 0; i < count; ++i){
+				auto const factor = factors[i];
+				if(factor.num > factor.denom) continue;
+
+				auto const scaled = TJSCALED(width, factor);
+				if(!smallest || scaled < TJSCALED(width, smallest.value())){
+					smallest = factor;
+				}
+				if(
+					static_cast< std::size_t >(scaled) <= max_width &&
+					(!fit || scaled > TJSCALED(width, fit.value()))
+				){
+					fit = factor;
+				}
+			}
+
+			auto const factor = fit ? fit.value() : smallest.value();
+			scaled_width = TJSCALED(width, factor);
+			scaled_height = TJSCALED(height, factor);
+		}
+
+		if(scaled_width == width && quality == 0) return data;
+
+		bool const gray = subsampling == TJSAMP_GRAY;
+		auto const format = gray ? TJPF_GRAY : TJPF_RGB;
+		std::vector< unsigned char > pixels(
+			static_cast< std::size_t >(scaled_width) * scaled_height
+			* tjPixelSize[format]);
+		if(tjDecompress2(decompressor.get(), jpg, data.size(), pixels.data(),
+			scaled_width, 0, scaled_height, format, 0) != 0
+		) throw std::runtime_error("tjDecompress2 failed");
+
+		std::unique_ptr< void, decltype(deleter) > compressor(
+			tjInitCompress(), deleter);
+		if(!compressor) throw std::runtime_error("tjInitCompress failed");
+
+		unsigned char* result = nullptr;
+		unsigned long size = 0;
+		if(tjCompress2(compressor.get(), pixels.data(),
+			scaled_width, 0, scaled_height, format, &result, &size,
+			gray ? TJSAMP_GRAY : TJSAMP_420, quality == 0 ? 90 : quality, 0
+		) != 0) throw std::runtime_error("tjCompress2 failed");
+
+		auto const result_deleter = [](unsigned char* data){ tjFree(data); };
+		std::unique_ptr< unsigned char, decltype(result_deleter) > result_ptr(
+			result, result_deleter);
+
+		return std::string(
+			reinterpret_cast< char const* >(result_ptr.get()), size);
+	}
+
+
+	/// \brief Frame variant a client asked for, 0 keeps the original
+	struct live_variant{
+		std::size_t max_width = 0;
+		int quality = 0;
+		bool deflate = false;
+
+		/// \brief Session did not get the previous frame of a delta stream
+		bool keyframe = false;
+	};
+
+	bool operator<(live_variant const& l, live_variant const& r){
+		return std::tie(l.max_width, l.quality, l.deflate, l.keyframe)
+			< std::tie(r.max_width, r.quality, r.deflate, r.keyframe);
+	}
+
+	bool operator==(live_variant const& l, live_variant const& r){
+		return std::tie(l.max_width, l.quality, l.deflate, l.keyframe)
+			== std::tie(r.max_width, r.quality, r.deflate, r.keyframe);
+	}
+
+
+	/// \brief A frame shared by all sessions
+	///
+	/// Every variant of the frame is made once by the first session that
+	/// needs it, the cache lives as long as the frame. The last session
+	/// that gets the frame moves its message out of the cache.
+	class live_frame{
+	public:
+		live_frame(
+			std::size_t sequence,
+			std::string&& data,
+			std::function< std::string() >&& keyframe
+		)
+			: sequence(sequence)
+			, data(std::move(data))
+			, keyframe(std::move(keyframe)) {}
+
+		template < typename Make >
+		std::string& cached(live_variant const& variant, Make&& make){
+			entry* result;
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				auto& ptr = cache_[variant];
+				if(!ptr) ptr = std::make_unique< entry >();
+				result = ptr.get();
+			}
+
+			std::call_once(result->flag, [result, &make]{
+					result->data = make();
+				});
+			return result->data;
+		}
+
+		std::size_t const sequence;
+		std::string data;
+
+		/// \brief Makes a full frame for sessions that did not get the
+		///        previous frame, empty if data is always a full frame
+		std::function< std::string() > const keyframe;
+
+		/// \brief Sessions that keep the frame as pending, guarded by the
+		///        mutex of the service
+		std::size_t waiting = 0;
+
+		/// \brief Shared while messages are copied, exclusive while the
+		///        last message is moved out
+		std::shared_mutex access;
+
+	private:
+		struct entry{
+			std::once_flag flag;
+			std::string data;
+		};
+
+		std::mutex mutex_;
+		std::map< live_variant, std::unique_ptr< entry > > cache_;
+	};
+
+
+	/// \brief Delivery state of a client of a live service
+	struct live_session{
+		using clock = std::chrono::steady_clock;
+
+		live_variant variant;
+
+		/// \brief Sequence of the last frame sent to the client
+		std::optional< std::size_t > last_sequence;
+
+		/// \brief Frames the client takes without a new 'ready'
+		std::size_t credits = 0;
+
+		/// \brief Latest frame that was not sent for lack of credits
+		std::shared_ptr< live_frame > pending;
+
+		std::size_t sent = 0;
+		std::size_t dropped = 0;
+
+		clock::time_point fps_start = clock::now();
+		std::size_t fps_frames = 0;
+		double fps = 0;
+
+		void count_sent(){
+			++sent;
+			++fps_frames;
+
+			auto const now = clock::now();
+			std::chrono::duration< double > const elapsed = now - fps_start;
+			if(elapsed.count() >= 1){
+				fps = fps_frames / elapsed.count();
+				fps_start = now;
+				fps_frames = 0;
+			}
+		}
+
+		/// \brief Variant of the next frame, a keyframe if the client did
+		///        not get the previous frame of a delta stream
+		live_variant next(live_frame const& frame){
+			auto result = variant;
+			result.keyframe = frame.keyframe && (!last_sequence
+				|| *last_sequence + 1 != frame.sequence);
+			last_sequence = frame.sequence;
+			return result;
+		}
+
+		nlohmann::json statistics()const{
+			// a client without frames for a while has a lower rate
+			std::chrono::duration< double > const elapsed =
+				clock::now() - fps_start;
+			return nlohmann::json::object({
+					{"fps", elapsed.count() >= 1
+						? fps_frames / elapsed.count() : fps},
+					{"sent", sent},
+					{"dropped", dropped},
+					{"credits", credits}
+				});
+		}
+	};
+
+
+	/// \brief Numbers after command, separated by single spaces
+	std::optional< std::vector< std::size_t > > parse_command(
+		std::string_view text,
+		std::string_view command
+	){
+		if(text.substr(0, command.size()) != command) return {};
+		text.remove_prefix(command.size());
+
+		std::vector< std::size_t > result;
+		while(!text.empty()){
+			if(text[0] != ' ') return {};
+			text.remove_prefix(1);
+
+			std::size_t value = 0;
+			auto const [end, ec] = std::from_chars(
+				text.data(), text.data() + text.size(), value);
+			if(ec != std::errc() || end == text.data()) return {};
+			result.push_back(value);
+			text.remove_prefix(end - text.data());
+		}
+		return result;
+	}
+
+
+	template < typename T >
+	void append_le(std::string& out, T value){
+		for(std::size_t i = 0; i < sizeof(T); ++i){
+			out.push_back(static_cast< char >((value >> (8 * i)) & 0xFF));
+		}
+	}
+
+
+	/// \brief Splits bitmaps into tiles and finds the changed ones by hash
+	///
+	/// Message layout, little endian: u8 type (0 keyframe, 1 delta),
+	/// u8 channels, u16 tile size, u32 width, u32 height, u32 tile count,
+	/// then for every tile u32 column, u32 row and its pixels row by row.
+	/// Tiles at the right and bottom border are smaller.
+	class tile_encoder{
+	public:
+		tile_encoder(std::size_t tile_size, std::size_t keyframe_interval)
+			: tile_size_(tile_size)
+			, keyframe_interval_(keyframe_interval) {}
+
+		/// \brief Changed tiles since the last image, all tiles if the size
+		///        changed or a periodic keyframe is due
+		///
+		/// The second value is true for a keyframe.
+		template < typename T >
+		std::pair< std::string, bool > delta(bmp::bitmap< T > const& image){
+			auto const columns = (image.width() + tile_size_ - 1) / tile_size_;
+			auto const rows = (image.height() + tile_size_ - 1) / tile_size_;
+
+			std::vector< std::uint64_t > hashes;
+			hashes.reserve(columns * rows);
+			for(std::size_t row = 0; row < rows; ++row){
+				for(std::size_t column = 0; column < columns; ++column){
+					hashes.push_back(hash(image, column, row));
+				}
+			}
+
+			std::lock_guard< std::mutex > lock(mutex_);
+			bool const keyframe =
+				image.width() != width_ || image.height() != height_ ||
+				(keyframe_interval_ > 0 && frames_ % keyframe_interval_ == 0);
+			++frames_;
+
+			std::vector< std::size_t > tiles;
+			for(std::size_t i = 0; i < hashes.size(); ++i){
+				if(keyframe || hashes[i] != hashes_[i]) tiles.push_back(i);
+			}
+
+			width_ = image.width();
+			height_ = image.height();
+			hashes_ = std::move(hashes);
+
+			return {message(image, keyframe, tiles), keyframe};
+		}
+
+		template < typename T >
+		std::string keyframe(bmp::bitmap< T > const& image)const{
+			auto const columns = (image.width() + tile_size_ - 1) / tile_size_;
+			auto const rows = (image.height() + tile_size_ - 1) / tile_size_;
+			std::vector< std::size_t > tiles(columns * rows);
+			std::iota(tiles.begin(), tiles.end(), std::size_t(0));
+			return message(image, true, tiles);
+		}
+
+
+	private:
+		template < typename T >
+		std::uint64_t hash(
+			bmp::bitmap< T > const& image,
+			std::size_t column,
+			std::size_t row
+		)const{
+			auto const x = column * tile_size_;
+			auto const y = row * tile_size_;
+			auto const w = std::min(tile_size_, image.width() - x);
+			auto const h = std::min(tile_size_, image.height() - y);
+
+			std::uint64_t result = 0;
+			for(std::size_t i = 0; i < h; ++i){
+				auto const line = reinterpret_cast< char const* >(
+					image.data() + (y + i) * image.width() + x);
+				result = xxhash64(std::string_view(line, w * sizeof(T)),
+					result);
+			}
+			return result;
+		}
+
+		template < typename T >
+		std::string message(
+			bmp::bitmap< T > const& image,
+			bool keyframe,
+			std::vector< std::size_t > const& tiles
+		)const{
+			auto const columns = (image.width() + tile_size_ - 1) / tile_size_;
+
+			std::string result;
+			result.reserve(16 + tiles.size()
+				* (8 + tile_size_ * tile_size_ * sizeof(T)));
+			append_le(result, std::uint8_t(keyframe ? 0 : 1));
+			append_le(result, std::uint8_t(sizeof(T)));
+			append_le(result, std::uint16_t(tile_size_));
+			append_le(result, std::uint32_t(image.width()));
+			append_le(result, std::uint32_t(image.height()));
+			append_le(result, std::uint32_t(tiles.size()));
+			for(auto const tile: tiles){
+				auto const column = tile % columns;
+				auto const row = tile / columns;
+				append_le(result, std::uint32_t(column));
+				append_le(result, std::uint32_t(row));
+
+				auto const x = column * tile_size_;
+				auto const y = row * tile_size_;
+				auto const w = std::min(tile_size_, image.width() - x);
+				auto const h = std::min(tile_size_, image.height() - y);
+				for(std::size_t i = 0; i < h; ++i){
+					auto const line = reinterpret_cast< char const* >(
+						image.data() + (y + i) * image.width() + x);
+					result.append(line, w * sizeof(T));
+				}
+			}
+			return result;
+		}
+
+
+		std::size_t const tile_size_;
+		std::size_t const keyframe_interval_;
+
+		std::mutex mutex_;
+		std::size_t width_ = 0;
+		std::size_t height_ = 0;
+		std::size_t frames_ = 0;
+		std::vector< std::uint64_t > hashes_;
+	};
+
+
 	template < typename Module >
 	class live_service
-		: public webservice::basic_ws_service< bool, std::string >{
+		: public webservice::basic_ws_service<
+			webservice::none_t, std::string >{
 	public:
-		live_service(Module module)
+		live_service(Module module, metrics& metrics)
 			: name(module("service_name"_param))
+			, window_(module("window"_param))
+			, deflate_level_(module("deflate_level"_param))
+			, deflate_min_size_(module("deflate_min_size"_param))
+			, tiles_(module("tile_size"_param),
+				module("keyframe_interval"_param))
+			, metrics_(metrics.live(name))
 			, module_(module) {}
 
 		void on_server_connect(
 			boost::asio::ip::tcp::socket&& socket,
 			webservice::http_request&& req
 		)override{
-			async_server_connect(std::move(socket), std::move(req), false);
+			async_server_connect(std::move(socket), std::move(req));
 		}
 
 		void on_open(webservice::ws_identifier identifier)override{
@@ -62,14 +702,30 @@ namespace disposer_module::http_server_component{
 				[this, identifier](logsys::stdlogb& os){
 					os << "live service(" << name << ") on_open identifier("
 						<< identifier << ")";
+				}, [this, identifier]{
+					std::lock_guard< std::mutex > lock(mutex_);
+					sessions_.emplace(identifier, live_session{});
+					++metrics_.sessions;
 				});
 		}
 
 		void on_close(webservice::ws_identifier identifier)override{
+			auto const statistics = [this, identifier]{
+					std::lock_guard< std::mutex > lock(mutex_);
+					auto const iter = sessions_.find(identifier);
+					if(iter == sessions_.end()) return nlohmann::json();
+					auto result = iter->second.statistics();
+					if(iter->second.pending) --iter->second.pending->waiting;
+					sessions_.erase(iter);
+					--metrics_.sessions;
+					return result;
+				}();
+
 			module_.log(
-				[this, identifier](logsys::stdlogb& os){
+				[this, identifier, &statistics](logsys::stdlogb& os){
 					os << "live service(" << name << ") on_close identifier("
-						<< identifier << ")";
+						<< identifier << "); statistics("
+						<< statistics.dump() << ")";
 				});
 		}
 
@@ -82,13 +738,38 @@ namespace disposer_module::http_server_component{
 					os << "live service(" << name << ") on_text identifier("
 						<< identifier << "); message(" << text << ")";
 				}, [this, identifier, &text]{
-					if(text != "ready"){
+					if(text == "statistics"){
+						std::unique_lock< std::mutex > lock(mutex_);
+						auto statistics =
+							sessions_.at(identifier).statistics().dump();
+						lock.unlock();
+						send_text(identifier, std::move(statistics));
+						return;
+					}
+
+					if(text == "deflate"){
+						enable_deflate(identifier);
+						return;
+					}
+
+					auto const variant = parse_command(text, "variant");
+					if(variant && variant->size() == 2){
+						set_variant(identifier, (*variant)[0], (*variant)[1]);
+						return;
+					}
+
+					auto const ready = parse_command(text, "ready");
+					if(
+						!ready || ready->size() > 1 ||
+						(ready->size() == 1 && ready->front() == 0)
+					){
 						throw std::runtime_error(
-							"live_service(" + name +
-							") message is not 'ready' but '" + text + "'");
+							"live_service(" + name + ") message is not "
+							"'ready', 'ready N' with N > 0, 'statistics', "
+							"'deflate' or 'variant W Q' but '" + text + "'");
 					}
 
-					set_value(identifier, true);
+					grant(identifier, ready->empty() ? 1 : ready->front());
 				});
 		}
 
@@ -111,51 +792,120 @@ namespace disposer_module::http_server_component{
 				});
 		}
 
-		void send(std::string data){
-			struct log_on_destruct{
-				log_on_destruct(live_service< Module >& this_)
-					: this_(this_)
-					, moved_(false) {}
-
-				log_on_destruct(log_on_destruct&& other)
-					: this_(other.this_)
-					, moved_(std::exchange(other.moved_, true))
-					, ready_identifiers_(std::move(other.ready_identifiers_)) {}
-
-
-				live_service< Module >& this_;
-				bool moved_;
-				std::set< webservice::ws_identifier > ready_identifiers_;
-
-				~log_on_destruct(){
-					if(moved_){
-						return;
+		/// \brief Send to every client with a credit, the others keep the
+		///        frame as their latest one
+		///
+		/// Every variant is made once. A message is copied only if some
+		/// clients get the frame now and others keep it for later, a
+		/// variant that fails is logged and the other clients still get
+		/// the frame.
+		void send(
+			std::string&& data,
+			std::function< std::string() >&& keyframe = {}
+		){
+			auto const frame = std::make_shared< live_frame >(
+				sequence_++, std::move(data), std::move(keyframe));
+
+			using targets_type = std::set< webservice::ws_identifier >;
+			std::map< live_variant, targets_type > targets;
+			std::size_t ticket;
+			std::shared_lock< std::shared_mutex > reading;
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				for(auto& [identifier, session]: sessions_){
+					if(session.credits > 0){
+						--session.credits;
+						session.count_sent();
+						targets[session.next(*frame)].insert(identifier);
+					}else{
+						if(session.pending){
+							++session.dropped;
+							++metrics_.frames_skipped;
+							--session.pending->waiting;
+						}
+						session.pending = frame;
+						++frame->waiting;
 					}
+				}
+				if(targets.empty()) return;
+				ticket = tickets_++;
 
-					this_.module_.log([this](logsys::stdlogb& os){
-							os << "live service(" << this_.name
-								<< ") send binary to sessions("
-								<< io_tools::range_to_string(ready_identifiers_)
+				// a grant that takes the frame last waits for the copies
+				if(frame->waiting > 0){
+					reading = std::shared_lock< std::shared_mutex >(
+						frame->access);
+				}
+			}
+			bool const last = !reading;
+
+			// encoding runs in parallel, only the sends are in order
+			std::vector< std::pair< targets_type, std::string > > messages;
+			std::vector< targets_type > failed;
+			try{
+				// all variants are made before the first one is moved
+				std::vector< std::pair< targets_type, std::string* > > buffers;
+				for(auto& [variant, identifiers]: targets){
+					auto const success = module_.exception_catching_log(
+						[this, &frame, &identifiers](logsys::stdlogb& os){
+							os << "live service(" << name
+								<< ") encode frame(" << frame->sequence
+								<< ") for sessions("
+								<< io_tools::range_to_string(identifiers)
 								<< ")";
+						}, [this, &frame, &buffers, &variant, &identifiers]{
+							auto& buffer = encode(*frame, variant);
+							buffers.emplace_back(std::move(identifiers),
+								&buffer);
 						});
+					if(!success) failed.push_back(std::move(identifiers));
 				}
-			};
 
-			send_binary_if([log = log_on_destruct{*this}](
-					webservice::ws_identifier identifier,
-					bool& ready
-				)mutable{
-					if(ready){
-						log.ready_identifiers_.emplace(identifier);
+				// variants can share a buffer, the last message takes it
+				std::map< std::string*, std::size_t > uses;
+				for(auto const& buffer: buffers) ++uses[buffer.second];
+				for(auto& [identifiers, buffer]: buffers){
+					messages.emplace_back(std::move(identifiers),
+						last && --uses[buffer] == 0
+							? std::move(*buffer) : std::string(*buffer));
+				}
+			}catch(...){
+				if(reading) reading.unlock();
+				dispatch(ticket, []{});
+				throw;
+			}
+			if(reading) reading.unlock();
+
+			for(auto const& identifiers: failed) discard(*frame, identifiers);
+
+			dispatch(ticket, [&]{
+					for(auto& [identifiers, message]: messages){
+						send_to(*frame, std::move(identifiers),
+							std::move(message));
 					}
-					return std::exchange(ready, false);
-				}, std::move(data));
+				});
+		}
+
+		/// \brief Send the changed tiles of image, clients that did not get
+		///        the previous frame get all tiles
+		template < typename T >
+		void send(bmp::bitmap< T >&& image){
+			auto const shared =
+				std::make_shared< bmp::bitmap< T > const >(std::move(image));
+			auto [data, keyframe] = tiles_.delta(*shared);
+			if(keyframe){
+				send(std::move(data));
+			}else{
+				send(std::move(data), [this, shared]{
+						return tiles_.keyframe(*shared);
+					});
+			}
 		}
 
 		void on_exception(
 			webservice::ws_identifier identifier,
 			std::exception_ptr error
 		)noexcept override{
+			++metrics_.errors;
 			module_.exception_catching_log(
 				[this, identifier](logsys::stdlogb& os){
 					os << "live service(" << name << ") identifier("
@@ -166,6 +916,7 @@ namespace disposer_module::http_server_component{
 		}
 
 		void on_exception(std::exception_ptr error)noexcept override{
+			++metrics_.errors;
 			module_.exception_catching_log(
 				[this](logsys::stdlogb& os){
 					os << "live service(" << name << ")";
@@ -178,7 +929,208 @@ namespace disposer_module::http_server_component{
 		std::string const name;
 
 	private:
+		/// \brief Add credits, a pending frame is sent at once
+		void grant(webservice::ws_identifier identifier, std::size_t credits){
+			std::shared_ptr< live_frame > frame;
+			live_variant variant;
+			std::size_t ticket;
+			std::shared_lock< std::shared_mutex > reading;
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				auto& session = sessions_.at(identifier);
+				session.credits = std::min(session.credits + credits, window_);
+				if(!session.pending) return;
+
+				frame = std::move(session.pending);
+				variant = session.next(*frame);
+				--session.credits;
+				session.count_sent();
+				ticket = tickets_++;
+
+				// the last session of the frame takes the message
+				if(--frame->waiting > 0){
+					reading = std::shared_lock< std::shared_mutex >(
+						frame->access);
+				}
+			}
+
+			std::string message;
+			try{
+				if(reading){
+					message = encode(*frame, variant);
+					reading.unlock();
+				}else{
+					std::unique_lock< std::shared_mutex > writing(
+						frame->access);
+					message = std::move(encode(*frame, variant));
+				}
+			}catch(...){
+				if(reading) reading.unlock();
+				dispatch(ticket, []{});
+				discard(*frame, {identifier});
+				throw;
+			}
+
+			dispatch(ticket, [&]{
+					send_to(*frame, {identifier}, std::move(message));
+				});
+		}
+
+		/// \brief Sessions that did not get the frame get their credit back
+		///        and a keyframe next
+		void discard(
+			live_frame const& frame,
+			std::set< webservice::ws_identifier > const& identifiers
+		){
+			++metrics_.errors;
+
+			std::lock_guard< std::mutex > lock(mutex_);
+			for(auto const identifier: identifiers){
+				auto const iter = sessions_.find(identifier);
+				if(iter == sessions_.end()) continue;
+
+				auto& session = iter->second;
+				if(session.last_sequence == frame.sequence){
+					session.last_sequence.reset();
+				}
+				session.credits = std::min(session.credits + 1, window_);
+			}
+		}
+
+		/// \brief Run send after all sends with a lower ticket
+		///
+		/// Tickets are taken together with live_session::next, so every
+		/// client gets its frames in the order of their sequences, which
+		/// tile deltas depend on.
+		template < typename Send >
+		void dispatch(std::size_t ticket, Send&& send){
+			std::unique_lock< std::mutex > lock(dispatch_mutex_);
+			dispatch_cv_.wait(lock, [this, ticket]{
+					return dispatched_ == ticket;
+				});
+
+			try{
+				send();
+			}catch(...){
+				++dispatched_;
+				dispatch_cv_.notify_all();
+				throw;
+			}
+
+			++dispatched_;
+			dispatch_cv_.notify_all();
+		}
+
+		void enable_deflate(webservice::ws_identifier identifier){
+			if(deflate_level_ == 0){
+				throw std::runtime_error("live_service(" + name
+					+ ") deflate is disabled by parameter deflate_level");
+			}
+
+			std::lock_guard< std::mutex > lock(mutex_);
+			sessions_.at(identifier).variant.deflate = true;
+		}
+
+		void set_variant(
+			webservice::ws_identifier identifier,
+			std::size_t max_width,
+			std::size_t quality
+		){
+			if(quality > 100){
+				throw std::runtime_error("live_service(" + name
+					+ ") variant quality must be in range 0 to 100");
+			}
+
+			std::lock_guard< std::mutex > lock(mutex_);
+			auto& variant = sessions_.at(identifier).variant;
+			variant.max_width = max_width;
+			variant.quality = static_cast< int >(quality);
+		}
+
+		/// \brief Message for a variant of the frame
+		///
+		/// Only JPEG frames are scaled and encoded, other frames are sent
+		/// as they are. Messages to deflate sessions start with one byte,
+		/// 0 for raw data and 1 for a zlib stream.
+		std::string& encode(
+			live_frame& frame,
+			live_variant const& variant
+		){
+			if(variant.deflate){
+				auto image = variant;
+				image.deflate = false;
+				auto const& data = encode(frame, image);
+				return frame.cached(variant, [this, &data]{
+						if(data.size() >= deflate_min_size_){
+							auto deflated = deflate(data, deflate_level_);
+							if(deflated.size() < data.size()){
+								return '\1' + deflated;
+							}
+						}
+						return '\0' + data;
+					});
+			}
+
+			if(variant.keyframe){
+				return frame.cached(live_variant{0, 0, false, true},
+					[&frame]{ return frame.keyframe(); });
+			}
+
+			if(variant == live_variant{} || !is_jpg(frame.data)){
+				return frame.data;
+			}
+
+			return frame.cached(variant, [&frame, &variant]{
+					return transcode_jpg(
+						frame.data, variant.max_width, variant.quality);
+				});
+		}
+
+		void send_to(
+			live_frame const& frame,
+			std::set< webservice::ws_identifier >&& targets,
+			std::string&& data
+		){
+			metrics_.frames_sent += targets.size();
+			metrics_.bytes_sent += targets.size() * data.size();
+
+			module_.log([this, &frame, &targets](logsys::stdlogb& os){
+					os << "live service(" << name
+						<< ") send frame(" << frame.sequence
+						<< ") binary to sessions("
+						<< io_tools::range_to_string(targets) << ")";
+				});
+
+			send_binary_if([targets = std::move(targets)](
+					webservice::ws_identifier identifier,
+					webservice::none_t&
+				){
+					return targets.count(identifier) > 0;
+				}, std::move(data));
+		}
+
+
+		std::size_t const window_;
+		int const deflate_level_;
+		std::size_t const deflate_min_size_;
+
+		tile_encoder tiles_;
+
+		live_metrics& metrics_;
+
 		Module module_;
+
+		std::atomic< std::size_t > sequence_{0};
+
+		std::mutex mutex_;
+		std::map< webservice::ws_identifier, live_session > sessions_;
+
+		/// \brief Next ticket of a send, guarded by mutex_
+		std::size_t tickets_ = 0;
+
+		std::mutex dispatch_mutex_;
+		std::condition_variable dispatch_cv_;
+		std::size_t dispatched_ = 0;
 	};
 
 
@@ -186,28 +1138,117 @@ namespace disposer_module::http_server_component{
 	class control_service: public webservice::basic_json_ws_service<
 			webservice::none_t, std::string >{
 	public:
-		control_service(Component component, webservice::server& server)
+		control_service(
+			Component component,
+			webservice::server& server,
+			metrics& metrics
+		)
 			: component_(component)
+			, metrics_(metrics)
 			, interval_(component_("min_interval_in_ms"_param))
-			, strand_(server.get_io_context().get_executor())
-			, timer_(server.get_io_context()) {}
+			, policy_(component_("schedule_policy"_param))
+			, io_context_(server.get_io_context())
+			, strand_(io_context_.get_executor()) {}
 
 
 	private:
+		using clock = std::chrono::steady_clock;
+
+		struct running_chains_data{
+			running_chains_data(
+				disposer::system_ref&& system,
+				std::string const& chain_name,
+				std::optional< std::size_t > exec_count,
+				std::chrono::milliseconds interval,
+				boost::asio::io_context& io_context,
+				chain_metrics& metrics
+			)
+				: name(chain_name)
+				, chain(system, chain_name)
+				, exec_count(exec_count)
+				, interval(interval)
+				, metrics(metrics)
+				, strand(io_context.get_executor())
+				, timer(io_context) {}
+
+			/// \brief Called at exec start with the deadline of its tick
+			void started(clock::time_point deadline){
+				auto const lateness = clock::now() - deadline;
+
+				std::lock_guard< std::mutex > lock(mutex);
+				++execs;
+				lateness_sum += lateness;
+				lateness_max = std::max(lateness_max, lateness);
+
+				// smoothed lateness variation like the RFC 3550 jitter
+				if(execs > 1){
+					auto const diff = lateness - last_lateness;
+					auto const abs_diff = diff < diff.zero() ? -diff : diff;
+					jitter += (abs_diff - jitter) / 16;
+				}
+				last_lateness = lateness;
+			}
+
+			void missed(std::size_t count){
+				std::lock_guard< std::mutex > lock(mutex);
+				missed_deadlines += count;
+			}
+
+			nlohmann::json statistics(){
+				using ms = std::chrono::duration< double, std::milli >;
+
+				std::lock_guard< std::mutex > lock(mutex);
+				return nlohmann::json::object({
+						{"interval-ms", interval.count()},
+						{"execs", execs},
+						{"missed", missed_deadlines},
+						{"lateness-mean-ms", execs == 0 ? 0. :
+							ms(lateness_sum).count() / execs},
+						{"lateness-max-ms", ms(lateness_max).count()},
+						{"jitter-ms", ms(jitter).count()}
+					});
+			}
+
+			std::string const name;
+			disposer::enabled_chain chain;
+			std::optional< std::size_t > const exec_count;
+			std::chrono::milliseconds const interval;
+			chain_metrics& metrics;
+
+			// timer, deadline and exec_counter are used on strand only
+			boost::asio::strand< boost::asio::io_context::executor_type >
+				strand;
+			boost::asio::steady_timer timer;
+			clock::time_point deadline;
+			std::size_t exec_counter = 0;
+			std::atomic< bool > stopped{false};
+
+			std::mutex mutex;
+			std::size_t execs = 0;
+			std::size_t missed_deadlines = 0;
+			clock::duration lateness_sum{};
+			clock::duration lateness_max{};
+			clock::duration last_lateness{};
+			clock::duration jitter{};
+		};
+
+
 		void add(
 			std::string chain,
-			std::optional< std::size_t > exec_count = {}
+			std::optional< std::size_t > exec_count = {},
+			std::optional< std::chrono::milliseconds > interval = {}
 		){
 			strand_.defer([
 					this,
 					lock = locker_.make_lock(),
 					chain = std::move(chain),
-					exec_count
+					exec_count,
+					interval
 				]{
 					component_.log(
 						[&chain](logsys::stdlogb& os){
 							os << "add live chain(" << chain << ")";
-						}, [this, &chain, exec_count]{
+						}, [this, &chain, exec_count, interval]{
 							if(is_shutdown()){
 								throw std::logic_error("can not add chain("
 									+ chain + ") while shutdown");
@@ -217,19 +1258,25 @@ namespace disposer_module::http_server_component{
 								throw std::logic_error("chain(" + chain
 									+ ") is already running");
 							}
-							chains_.try_emplace(
-								chain,
+
+							auto data = std::make_shared< running_chains_data >(
 								component_.system(),
 								chain,
-								exec_count);
+								exec_count,
+								interval.value_or(interval_),
+								io_context_,
+								metrics_.chain(chain));
+							chains_.emplace(chain, data);
+							++metrics_.chains_running;
 
 							send_text(nlohmann::json::object(
 								{{"run-chain", chain}}));
 
-							if(chains_.size() == 1){
-								timer_.expires_after(interval_);
-								run();
-							}
+							boost::asio::post(data->strand, [this, data]{
+									data->deadline =
+										clock::now() + data->interval;
+									run(data);
+								});
 						});
 				}, std::allocator< void >());
 		}
@@ -245,43 +1292,92 @@ namespace disposer_module::http_server_component{
 				}, std::allocator< void >());
 		}
 
-		void run(){
-			timer_.async_wait(boost::asio::bind_executor(
-				strand_,
+		/// \brief Erase a chain from its own strand
+		///
+		/// The chain might already be erased and a new one with the same
+		/// name added.
+		void finish(std::shared_ptr< running_chains_data > data)noexcept{
+			strand_.defer(
+				[
+					this,
+					lock = locker_.make_lock(),
+					data = std::move(data)
+				]()noexcept{
+					auto const iter = chains_.find(data->name);
+					if(iter != chains_.end() && iter->second == data){
+						lockless_erase(data->name);
+					}
+				}, std::allocator< void >());
+		}
+
+		/// \brief Wait for the next deadline of a chain on its strand
+		///
+		/// Every chain has its own timer and interval, so chains tick at
+		/// their own rate and in parallel. The rate is fixed, the next
+		/// deadline does not depend on the exec time.
+		void run(std::shared_ptr< running_chains_data > const& data){
+			data->timer.expires_at(data->deadline);
+			data->timer.async_wait(boost::asio::bind_executor(
+				data->strand,
 				[
 					this,
-					lock = locker_.make_lock()
+					lock = locker_.make_lock(),
+					data
 				](boost::system::error_code const& error){
-					if(error == boost::asio::error::operation_aborted){
+					if(
+						error == boost::asio::error::operation_aborted ||
+						data->stopped
+					){
 						return;
 					}
 
-					timer_.expires_after(interval_);
+					// test shutdown because on_shutdown is not stranded
+					if(is_shutdown()){
+						finish(data);
+						return;
+					}
 
-					if(!is_shutdown()){
-						for(auto& [name, data]: chains_){
-							component_.exception_catching_log(
-								[&name = name](logsys::stdlogb& os){
-									os << "server live exec chain("
-										<< name << ")";
-								}, [this, &name = name, &data = data]{
-									auto& [chain, count, counter] = data;
-									++counter;
-									chain.exec();
-									if(count && counter >= *count){
-										lockless_erase(name);
-									}
-								});
+					auto const deadline = data->deadline;
+					auto const interval = data->interval;
+					data->deadline += interval;
+
+					// a tick that starts after the deadline of the next one
+					// missed its deadline, in both policies
+					auto const now = clock::now();
+					if(data->deadline <= now){
+						std::size_t skipped = 0;
+						if(policy_ == schedule_policy::skip){
+							skipped = static_cast< std::size_t >(
+								(now - data->deadline) / interval) + 1;
+							data->deadline += skipped * interval;
 						}
+						data->missed(skipped + 1);
 					}
 
-					// test shutdown again because on_shutdown is not stranded
-					if(is_shutdown()){
-						for(auto& [name, data]: chains_){
-							lockless_erase(name);
-						}
-					}else{
-						run();
+					// the next tick waits on the strand until exec is done
+					run(data);
+
+					++data->exec_counter;
+					data->started(deadline);
+					++metrics_.execs_running;
+					auto const start = clock::now();
+					auto const success = component_.exception_catching_log(
+						[&data](logsys::stdlogb& os){
+							os << "server live exec chain(" << data->name
+								<< ")";
+						}, [&data]{
+							data->chain.exec();
+						});
+					data->metrics.exec_seconds.observe(clock::now() - start);
+					++data->metrics.execs;
+					if(!success) ++data->metrics.errors;
+					--metrics_.execs_running;
+
+					auto const& count = data->exec_count;
+					if(count && data->exec_counter >= *count){
+						data->stopped = true;
+						data->timer.cancel();
+						finish(data);
 					}
 				}));
 		}
@@ -300,10 +1396,21 @@ namespace disposer_module::http_server_component{
 				[&chain](logsys::stdlogb& os){
 					os << "erase live chain(" << chain << ")";
 				}, [this, &chain]{
-					if(chains_.erase(chain) == 0){
+					auto const iter = chains_.find(chain);
+					if(iter == chains_.end()){
 						throw std::logic_error("chain(" + chain
 							+ ") is not running");
 					}
+
+					// a running exec keeps the data until it is done
+					auto data = std::move(iter->second);
+					chains_.erase(iter);
+					--metrics_.chains_running;
+					data->stopped = true;
+					boost::asio::post(data->strand, [data]{
+							data->timer.cancel();
+						});
+
 					send_text(nlohmann::json::object({{"stop-chain", chain}}));
 				});
 		}
@@ -318,6 +1425,19 @@ namespace disposer_module::http_server_component{
 			return nlohmann::json::object({{"running-chains", chains}});
 		}
 
+		nlohmann::json lockless_statistics_message(
+			std::optional< std::string > const& chain
+		){
+			auto statistics = nlohmann::json::object();
+			for(auto const& [name, data]: chains_){
+				if(chain && *chain != name) continue;
+				statistics[name] = data->statistics();
+			}
+
+			return nlohmann::json::object(
+				{{"chain-statistics", statistics}});
+		}
+
 
 		void on_open(webservice::ws_identifier identifier)override{
 			component_.log(
@@ -360,11 +1480,47 @@ namespace disposer_module::http_server_component{
 					}
 					os << ")";
 				},
-				[this, &data]{
+				[this, identifier, &data]{
+					auto const statistics =
+						get_optional< bool >(data, "statistics");
+					if(statistics && *statistics){
+						strand_.defer([
+								this,
+								lock = locker_.make_lock(),
+								identifier,
+								chain = get_optional< std::string >(
+									data, "chain")
+							]{
+								send_text(identifier,
+									lockless_statistics_message(chain));
+							}, std::allocator< void >());
+						return;
+					}
+
 					auto const chain =
 						data.at("chain").get< std::string >();
 					auto const live = get_optional< bool >(data, "live");
 					auto const exec = get_optional< int >(data, "exec");
+					auto const interval_in_ms =
+						get_optional< int >(data, "interval_in_ms");
+
+					std::optional< std::chrono::milliseconds > interval;
+					if(interval_in_ms){
+						if(*interval_in_ms < 1){
+							throw std::logic_error("json message chain "
+								"interval_in_ms is less than 1 (" +
+								std::to_string(*interval_in_ms) + ")");
+						}
+						if(static_cast< std::uint32_t >(*interval_in_ms)
+							> max_interval_in_ms
+						){
+							throw std::logic_error("json message chain "
+								"interval_in_ms is greater than " +
+								std::to_string(max_interval_in_ms) + " (" +
+								std::to_string(*interval_in_ms) + ")");
+						}
+						interval = std::chrono::milliseconds(*interval_in_ms);
+					}
 
 					if(live && exec){
 						throw std::logic_error("json message chain "
@@ -373,7 +1529,7 @@ namespace disposer_module::http_server_component{
 
 					if(live){
 						if(*live){
-							add(chain);
+							add(chain, {}, interval);
 						}else{
 							erase(chain);
 						}
@@ -385,7 +1541,8 @@ namespace disposer_module::http_server_component{
 								std::to_string(exec_count) + ")");
 						}
 
-						add(chain, static_cast< std::size_t >(exec_count));
+						add(chain, static_cast< std::size_t >(exec_count),
+							interval);
 					}else{
 						throw std::logic_error("json message chain "
 							"without live and exec");
@@ -429,6 +1586,7 @@ namespace disposer_module::http_server_component{
 			webservice::ws_identifier identifier,
 			std::exception_ptr error
 		)noexcept override{
+			++metrics_.control_errors;
 			component_.exception_catching_log(
 				[identifier](logsys::stdlogb& os){
 					os << "control service identifier(" << identifier << ")";
@@ -438,6 +1596,7 @@ namespace disposer_module::http_server_component{
 		}
 
 		void on_exception(std::exception_ptr error)noexcept override{
+			++metrics_.control_errors;
 			component_.exception_catching_log(
 				[](logsys::stdlogb& os){
 					os << "control service";
@@ -446,30 +1605,35 @@ namespace disposer_module::http_server_component{
 				});
 		}
 
+		/// \brief Cancel the timers of all chains, a pending wait would
+		///        delay the shutdown by its interval
+		void on_shutdown()noexcept override{
+			strand_.defer([this, lock = locker_.make_lock()]()noexcept{
+					for(auto const& [name, data]: chains_){
+						(void)name;
+						data->stopped = true;
+						boost::asio::post(data->strand, [data]{
+								data->timer.cancel();
+							});
+					}
+				}, std::allocator< void >());
 
-		struct running_chains_data{
-			running_chains_data(
-				disposer::system_ref&& system,
-				std::string const& chain_name,
-				std::optional< std::size_t > exec_count
-			)
-				: chain(system, chain_name)
-				, exec_count(exec_count) {}
+			basic_json_ws_service::on_shutdown();
+		}
 
-			disposer::enabled_chain chain;
-			std::optional< std::size_t > exec_count;
-			std::size_t exec_counter = 0;
-		};
 
 
 		Component component_;
+		metrics& metrics_;
 
 		std::chrono::milliseconds const interval_;
+		schedule_policy const policy_;
 
+		boost::asio::io_context& io_context_;
 		boost::asio::strand< boost::asio::io_context::executor_type > strand_;
-		boost::asio::steady_timer timer_;
 
-		std::map< std::string, running_chains_data > chains_;
+		std::map< std::string, std::shared_ptr< running_chains_data > >
+			chains_;
 	};
 
 
@@ -517,12 +1681,86 @@ namespace disposer_module::http_server_component{
 	};
 
 
+	std::string_view to_std(boost::beast::string_view text){
+		return {text.data(), text.size()};
+	}
+
+	char const* mime_type(std::string_view path){
+		auto const pos = path.rfind('.');
+		if(pos == std::string_view::npos) return "application/octet-stream";
+		auto const extension = path.substr(pos + 1);
+		if(extension == "html" || extension == "htm") return "text/html";
+		if(extension == "css") return "text/css";
+		if(extension == "js") return "application/javascript";
+		if(extension == "json" || extension == "map"){
+			return "application/json";
+		}
+		if(extension == "txt") return "text/plain";
+		if(extension == "svg") return "image/svg+xml";
+		if(extension == "png") return "image/png";
+		if(extension == "jpg" || extension == "jpeg") return "image/jpeg";
+		if(extension == "gif") return "image/gif";
+		if(extension == "ico") return "image/vnd.microsoft.icon";
+		if(extension == "wasm") return "application/wasm";
+		return "application/octet-stream";
+	}
+
+	std::string_view trim(std::string_view text){
+		while(!text.empty() && text.front() == ' ') text.remove_prefix(1);
+		while(!text.empty() && text.back() == ' ') text.remove_suffix(1);
+		return text;
+	}
+
+	/// \brief Call f with every trimmed element of a comma separated list
+	template < typename F >
+	void for_each_element(std::string_view list, F&& f){
+		while(!list.empty()){
+			auto const pos = list.find(',');
+			f(trim(list.substr(0, pos)));
+			if(pos == std::string_view::npos) return;
+			list.remove_prefix(pos + 1);
+		}
+	}
+
+	/// \brief Accept-Encoding contains coding without q=0
+	bool accepts(std::string_view accept_encoding, std::string_view coding){
+		bool result = false;
+		for_each_element(accept_encoding, [&result, coding](auto element){
+				auto const pos = element.find(';');
+				if(trim(element.substr(0, pos)) != coding) return;
+				if(pos == std::string_view::npos){
+					result = true;
+					return;
+				}
+
+				auto const q = trim(element.substr(pos + 1));
+				result = q.substr(0, 2) != "q=" ||
+					q.find_first_not_of("0.", 2) != std::string_view::npos;
+			});
+		return result;
+	}
+
+	/// \brief If-None-Match contains etag or '*', weak tags match too
+	bool etag_matches(std::string_view if_none_match, std::string_view etag){
+		bool result = false;
+		for_each_element(if_none_match, [&result, etag](auto element){
+				if(element.substr(0, 2) == "W/") element.remove_prefix(2);
+				if(element == etag || element == "*") result = true;
+			});
+		return result;
+	}
+
+
 	template < typename Component >
 	class file_request_handler: public webservice::file_request_handler{
 	public:
-		file_request_handler(Component component)
+		file_request_handler(Component component, metrics const& metrics)
 			: webservice::file_request_handler(component("root"_param))
-			, component_(component) {}
+			, component_(component)
+			, metrics_(metrics)
+			, cache_(component("file_cache_bytes"_param) == 0 ? nullptr
+				: std::make_unique< file_cache >(component("root"_param),
+					component("file_cache_bytes"_param))) {}
 
 		void operator()(
 			webservice::http_request&& req,
@@ -532,12 +1770,110 @@ namespace disposer_module::http_server_component{
 				[resource = req.target()](logsys::stdlogb& os){
 					os << "http file handler get (" << resource << ")";
 				}, [this, &req, &send]{
+					if(req.target() == "/metrics"){
+						namespace http = boost::beast::http;
+						http::response< http::string_body > res{
+							http::status::ok, req.version()};
+						res.set(http::field::content_type,
+							"text/plain; version=0.0.4");
+						res.keep_alive(req.keep_alive());
+						res.body() = metrics_.text() + cache_metrics();
+						res.prepare_payload();
+						send(std::move(res));
+						return;
+					}
+
+					if(cache_ && serve_cached(req, send)) return;
+
 					webservice::file_request_handler::operator()(
 						std::move(req), std::move(send));
 				});
 		}
 
 	private:
+		/// \brief Answer from the file cache, false if the file is not
+		///        cached
+		bool serve_cached(
+			webservice::http_request const& req,
+			webservice::http_response& send
+		){
+			namespace http = boost::beast::http;
+			if(
+				req.method() != http::verb::get &&
+				req.method() != http::verb::head
+			) return false;
+
+			auto const target = to_std(req.target());
+			std::string path(target.substr(0, target.find('?')));
+			if(!path.empty() && path.back() == '/') path += "index.html";
+
+			auto const entry = cache_->get(path);
+			if(!entry) return false;
+
+			auto const accept_encoding =
+				to_std(req[http::field::accept_encoding]);
+			auto file = &entry->identity;
+			char const* encoding = nullptr;
+			if(entry->brotli && accepts(accept_encoding, "br")){
+				file = &*entry->brotli;
+				encoding = "br";
+			}else if(entry->gzip && accepts(accept_encoding, "gzip")){
+				file = &*entry->gzip;
+				encoding = "gzip";
+			}
+
+			auto const if_none_match = to_std(req[http::field::if_none_match]);
+			auto const if_modified_since =
+				to_std(req[http::field::if_modified_since]);
+			bool not_modified = false;
+			if(!if_none_match.empty()){
+				not_modified = etag_matches(if_none_match, file->etag);
+			}else if(!if_modified_since.empty()){
+				auto const since =
+					parse_http_date(std::string(if_modified_since));
+				not_modified = since && entry->mtime <= *since;
+			}
+
+			http::response< http::string_body > res{not_modified
+				? http::status::not_modified : http::status::ok,
+				req.version()};
+			res.set(http::field::etag, file->etag);
+			res.set(http::field::last_modified, entry->last_modified);
+			res.set(http::field::cache_control, "no-cache");
+			if(entry->gzip || entry->brotli){
+				res.set(http::field::vary, "Accept-Encoding");
+			}
+			res.keep_alive(req.keep_alive());
+
+			if(!not_modified){
+				res.set(http::field::content_type, mime_type(path));
+				if(encoding) res.set(http::field::content_encoding, encoding);
+				if(req.method() == http::verb::head){
+					res.content_length(file->data.size());
+				}else{
+					res.body() = file->data;
+					res.prepare_payload();
+				}
+			}
+
+			send(std::move(res));
+			return true;
+		}
+
+		std::string cache_metrics()const{
+			if(!cache_) return {};
+
+			std::ostringstream os;
+			os << "# TYPE http_server_file_cache_hits_total counter\n"
+				<< "http_server_file_cache_hits_total " << cache_->hits
+				<< "\n# TYPE http_server_file_cache_misses_total counter\n"
+				<< "http_server_file_cache_misses_total " << cache_->misses
+				<< "\n# TYPE http_server_file_cache_bytes gauge\n"
+				<< "http_server_file_cache_bytes " << cache_->bytes()
+				<< '\n';
+			return os.str();
+		}
+
 		void on_exception(std::exception_ptr error)noexcept override{
 			component_.exception_catching_log(
 				[](logsys::stdlogb& os){
@@ -549,6 +1885,8 @@ namespace disposer_module::http_server_component{
 
 
 		Component component_;
+		metrics const& metrics_;
+		std::unique_ptr< file_cache > cache_;
 	};
 
 
@@ -615,8 +1953,8 @@ namespace disposer_module::http_server_component{
 						Component component_;
 					};
 
-					auto service =
-						std::make_unique< live_service< Module > >(module);
+					auto service = std::make_unique< live_service< Module > >(
+						module, *metrics_);
 
 					service->set_ping_time(std::chrono::milliseconds(
 						component_("timeout_in_ms"_param)));
@@ -638,10 +1976,12 @@ namespace disposer_module::http_server_component{
 			Component component
 		)
 			: component_(component)
+			, metrics_(std::make_unique< metrics >(
+					component("thread_count"_param)))
 			, ws_handler_(*ws_handler.get())
 			, server_(std::make_unique< webservice::server >(
 					std::make_unique< file_request_handler< Component > >(
-						component),
+						component, *metrics_),
 					std::move(ws_handler),
 					std::make_unique< error_handler< Component > >(component),
 					boost::asio::ip::make_address(component("address"_param)),
@@ -656,7 +1996,7 @@ namespace disposer_module::http_server_component{
 					auto control_service =
 						std::make_unique< http_server_component::
 							control_service< Component >
-						>(component_, *server_);
+						>(component_, *server_, *metrics_);
 
 					control_service->set_ping_time(std::chrono::milliseconds(
 						component_("timeout_in_ms"_param)));
@@ -666,6 +2006,7 @@ namespace disposer_module::http_server_component{
 		}
 
 		Component component_;
+		std::unique_ptr< metrics > metrics_;
 		ws_service_handler< Component >& ws_handler_;
 		std::unique_ptr< webservice::server > server_;
 	};
@@ -681,10 +2022,23 @@ namespace disposer_module::http_server_component{
 		auto init = generate_component(
 			"the web server has a web socket named 'controller' which can be "
 			"used to enable and disable the execution of a chains at regular "
-			"intervals",
+			"intervals; the route /metrics reports chain execs and latency, "
+			"live service sessions, frames and bytes, websocket errors and "
+			"the thread count in the Prometheus text format",
 			component_configure(
 				make("root"_param, free_type_c< std::string >,
 					"path to the http server root directory"),
+				make("file_cache_bytes"_param, free_type_c< std::size_t >,
+					"memory budget of the cache for files in root, 0 "
+					"disables it; cached files are answered with ETag and "
+					"Last-Modified and with 304 to conditional requests, "
+					"their .gz and .br siblings are sent to clients that "
+					"accept them, files are dropped if they change on disk "
+					"(inotify) or if they were least recently used and the "
+					"budget is exceeded; files larger than the budget are "
+					"served from disk, siblings that do not fit are left "
+					"out",
+					default_value(64 * 1024 * 1024)),
 				make("address"_param, free_type_c< std::string >,
 					"address of the server",
 					default_value("0::0")),
@@ -692,15 +2046,44 @@ namespace disposer_module::http_server_component{
 					"port of the server",
 					default_value(8000)),
 				make("thread_count"_param, free_type_c< std::uint8_t >,
-					"thread count to process http and websocket requests",
+					"thread count to process http and websocket requests "
+					"and to exec live chains, different chains are executed "
+					"in parallel",
 					default_value(2),
 					verify_value_fn([](std::uint8_t value){
 						if(value > 0) return;
 						throw std::logic_error("must be greater or equal 1");
 					})),
 				make("min_interval_in_ms"_param, free_type_c< std::uint32_t >,
-					"time between exec calls on live chains",
-					default_value(50)),
+					"default time between exec calls on live chains, every "
+					"chain has its own timer, a chain can set its own "
+					"interval by \"interval_in_ms\" in its control message; "
+					"intervals are limited to one hour",
+					default_value(50),
+					verify_value_fn([](std::uint32_t value){
+						if(value > max_interval_in_ms){
+							throw std::logic_error(
+								"must be less or equal one hour");
+						}
+					})),
+				make("schedule_policy"_param, free_type_c< schedule_policy >,
+					"live chains are executed at a fixed rate, the deadlines "
+					"do not drift by exec times; behavior if the server falls "
+					"behind by more than one interval:\n"
+					"* catch_up => the missed ticks are executed without "
+					"delay until the schedule is reached again\n"
+					"* skip => the missed ticks are dropped and the next "
+					"deadline is the next multiple of the interval\n"
+					"per chain execs, missed deadlines, lateness and jitter "
+					"are sent on the control message "
+					"{\"statistics\": true} (optional with \"chain\"); a "
+					"missed deadline is a dropped tick or a tick that starts "
+					"after the deadline of the next one",
+					parser_fn([](std::string_view data){
+						return parse_enum< schedule_policy >(
+							data, schedule_policy_list);
+					}),
+					default_value(schedule_policy::skip)),
 				make("timeout_in_ms"_param, free_type_c< std::uint32_t >,
 					"time out for websocket connections",
 					default_value(15000))
@@ -710,24 +2093,92 @@ namespace disposer_module::http_server_component{
 			}),
 			component_modules(
 				make("websocket"_module, generate_module(
-					"send data via websocket to all connected clients",
+					"send data via websocket to all connected clients; a "
+					"client controls its stream by text messages: 'ready' "
+					"and 'ready N' grant frames (see window), 'deflate' "
+					"enables compression (see deflate_level), 'statistics' "
+					"is answered with the fps, sent and dropped frames of "
+					"the client and 'variant W Q' asks for JPEG frames with "
+					"a max width W and a JPEG quality Q (0 keeps the "
+					"original), frames are scaled by the DCT scaling of the "
+					"decoder and every variant of a frame is encoded once "
+					"for all clients",
+					dimension_list{
+						dimension_c<
+							std::string,
+							bmp::bitmap< std::uint8_t >,
+							bmp::bitmap< bmp::pixel::rgb8 >
+						>
+					},
 					module_configure(
-						make("data"_in, free_type_c< std::string >,
+						make("data"_in, type_ref_c< 0 >,
 							"data to be send (only last entry is send if "
-							"there are more then one per exec)"),
+							"there are more then one per exec); bitmaps are "
+							"split into tiles and only changed tiles are "
+							"sent, see www/live_tiles.js for the format and "
+							"a decoder"),
 						make("service_name"_param, free_type_c< std::string >,
-							"name of the websocket service")
+							"name of the websocket service"),
+						make("window"_param, free_type_c< std::size_t >,
+							"frames a client can have in flight, a client "
+							"grants frames by the text message 'ready' (one "
+							"frame) or 'ready N' (N frames, at most window); "
+							"a client without credits gets the latest frame "
+							"as soon as it grants again, older frames are "
+							"dropped",
+							default_value(1),
+							verify_value_fn([](std::size_t value){
+								if(value > 0) return;
+								throw std::logic_error(
+									"must be greater or equal 1");
+							})),
+						make("deflate_level"_param, free_type_c< int >,
+							"zlib level (1 to 9, 0 disables deflate), a "
+							"client can send "
+							"the text message 'deflate', then every binary "
+							"message to it starts with one byte: 0 for raw "
+							"data and 1 for a zlib stream (read it by "
+							"DecompressionStream('deflate')); a frame is "
+							"deflated once for all clients",
+							default_value(0),
+							verify_value_fn([](int value){
+								if(value >= 0 && value <= 9) return;
+								throw std::logic_error(
+									"must be in range 0 to 9");
+							})),
+						make("deflate_min_size"_param,
+							free_type_c< std::size_t >,
+							"smaller frames are sent raw to deflate clients, "
+							"frames are also sent raw if deflate does not "
+							"make them smaller",
+							default_value(1024)),
+						make("tile_size"_param, free_type_c< std::size_t >,
+							"edge length of the tiles of bitmap data, a tile "
+							"is sent if its xxHash64 changed",
+							default_value(64),
+							verify_value_fn([](std::size_t value){
+								if(value > 0 && value <= 0xFFFF) return;
+								throw std::logic_error(
+									"must be in range 1 to 65535");
+							})),
+						make("keyframe_interval"_param,
+							free_type_c< std::size_t >,
+							"every keyframe_interval-th bitmap is sent with "
+							"all tiles to resynchronize all clients, 0 "
+							"disables periodic keyframes; a client that "
+							"missed the previous frame always gets all tiles",
+							default_value(100))
 					),
 					module_init_fn([](auto module){
 						return module.component.state()
 							.add_live_service(module);
 					}),
 					exec_fn([](auto& module){
-						auto list = module("data"_in).references();
+						auto list = module("data"_in).values();
 						if(list.empty()) return;
 						auto iter = list.end();
 						--iter;
-						module.state()->service.send(*iter);
+						module.state()->service.send(std::move(*iter));
 					}),
 					no_overtaking
 				))
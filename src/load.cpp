@@ -6,6 +6,8 @@
 // Distributed under the Boost Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
 //-----------------------------------------------------------------------------
+#include "read_files.hpp"
+
 #include <disposer/module.hpp>
 
 #include <io_tools/name_generator.hpp>
@@ -74,88 +76,6 @@ namespace disposer_module::load{
 	using j_type = typename type_transform< T >::j_type;
 
 
-	void verify_stream(std::ifstream& is, std::string const& filename){
-		if(is) return;
-		throw std::runtime_error("Can not read file '" + filename + "'");
-	}
-
-	template < typename Module >
-	t1 load(
-		Module module,
-		ng1 const& name,
-		std::size_t id,
-		std::size_t subid
-	){
-		auto const filename = name(id, subid);
-		return module.log([&filename](logsys::stdlogb& os){
-				os << filename;
-			}, [&filename]{
-				std::ifstream is(filename.c_str(),
-					std::ios::in | std::ios::binary);
-				verify_stream(is, filename);
-				return std::string(
-					std::istreambuf_iterator<char>(is),
-					std::istreambuf_iterator<char>());
-			});
-	}
-
-	template < typename Module >
-	t2 load(
-		Module module,
-		ng2 const& name,
-		std::size_t id,
-		std::size_t subid,
-		std::size_t ic
-	){
-		std::vector< std::string > result;
-		result.reserve(ic);
-		for(std::size_t i = 0; i < ic; ++i){
-			auto const filename = name(id, subid, i);
-			module.log([&filename](logsys::stdlogb& os){
-					os << filename;
-				}, [&filename, &result]{
-					std::ifstream is(filename.c_str(),
-						std::ios::in | std::ios::binary);
-					verify_stream(is, filename);
-					result.emplace_back(
-						std::istreambuf_iterator<char>(is),
-						std::istreambuf_iterator<char>());
-				});
-		}
-		return result;
-	}
-
-	template < typename Module >
-	t3 load(
-		Module module,
-		ng3 const& name,
-		std::size_t id,
-		std::size_t subid,
-		std::size_t ic,
-		std::size_t jc
-	){
-		std::vector< std::vector< std::string > > result;
-		result.reserve(ic);
-		for(std::size_t i = 0; i < ic; ++i){
-			result.emplace_back().reserve(ic);
-			for(std::size_t j = 0; j < jc; ++j){
-				auto const filename = name(id, subid, i, j);
-				module.log([&filename](logsys::stdlogb& os){
-						os << filename;
-					}, [&filename, &result]{
-						std::ifstream is(filename.c_str(),
-							std::ios::in | std::ios::binary);
-						verify_stream(is, filename);
-						result.back().emplace_back(
-							std::istreambuf_iterator<char>(is),
-							std::istreambuf_iterator<char>());
-				});
-			}
-		}
-		return result;
-	}
-
-
 	struct format{
 		std::size_t const digits;
 		std::size_t const add;
@@ -220,6 +140,28 @@ namespace disposer_module::load{
 						return iter - list.begin();
 					}),
 					default_value(0)),
+				make("backend"_param, free_type_c< read_backend >,
+					read_backend_description,
+					parser_fn([](std::string_view data){
+						return parse_enum< read_backend >(
+							data, read_backend_list);
+					}),
+					default_value(read_backend::iostream)),
+				make("cache_mode"_param, free_type_c< cache_mode >,
+					cache_mode_description,
+					parser_fn([](std::string_view data){
+						return parse_enum< cache_mode >(
+							data, cache_mode_list);
+					}),
+					default_value(cache_mode::cached)),
+				make("compression"_param, free_type_c< compression >,
+					"codec the files are compressed with, they are "
+					"decompressed after reading (none, lz4, zstd)",
+					parser_fn([](std::string_view data){
+						return parse_enum< compression >(
+							data, compression_list);
+					}),
+					default_value(compression::none)),
 				make("fixed_id"_param,
 					free_type_c< std::optional< std::size_t > >,
 					"used instead of the exec ID if set"),
@@ -331,6 +273,11 @@ namespace disposer_module::load{
 					})
 				)
 			),
+			module_init_fn([](auto const module){
+				return make_read_state(module, module("backend"_param),
+					module("cache_mode"_param),
+					module("compression"_param));
+			}),
 			exec_fn([](auto module){
 				auto id = module.id();
 
@@ -345,17 +292,48 @@ namespace disposer_module::load{
 				using type = typename
 					decltype(module.dimension(hana::size_c< 0 >))::type;
 
+				auto const& name = module("name"_param);
+				std::vector< std::string > filenames;
+				for(std::size_t subid = 0; subid < subid_count; ++subid){
+					if constexpr(std::is_same_v< type, t1 >){
+						filenames.push_back(name(id, subid));
+					}else if constexpr(std::is_same_v< type, t2 >){
+						auto const ic = module("i_count"_param);
+						for(std::size_t i = 0; i < ic; ++i){
+							filenames.push_back(name(id, subid, i));
+						}
+					}else if constexpr(std::is_same_v< type, t3 >){
+						auto const ic = module("i_count"_param);
+						auto const jc = module("j_count"_param);
+						for(std::size_t i = 0; i < ic; ++i){
+							for(std::size_t j = 0; j < jc; ++j){
+								filenames.push_back(name(id, subid, i, j));
+							}
+						}
+					}
+				}
+
+				auto data = read_files(module, *module.state(), filenames);
+				auto iter = std::make_move_iterator(data.begin());
+
 				auto& out = module("content"_out);
 				for(std::size_t subid = 0; subid < subid_count; ++subid){
 					if constexpr(std::is_same_v< type, t1 >){
-						out.push(load(module, module("name"_param), id, subid));
+						out.push(*iter++);
 					}else if constexpr(std::is_same_v< type, t2 >){
-						out.push(load(module, module("name"_param), id, subid,
-							module("i_count"_param)));
+						auto const ic = module("i_count"_param);
+						out.push(t2(iter, iter + ic));
+						iter += ic;
 					}else if constexpr(std::is_same_v< type, t3 >){
-						out.push(load(module, module("name"_param), id, subid,
-							module("i_count"_param),
-							module("j_count"_param)));
+						auto const ic = module("i_count"_param);
+						auto const jc = module("j_count"_param);
+						t3 result;
+						result.reserve(ic);
+						for(std::size_t i = 0; i < ic; ++i){
+							result.emplace_back(iter, iter + jc);
+							iter += jc;
+						}
+						out.push(std::move(result));
 					}
 				}
 			})
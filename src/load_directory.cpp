@@ -0,0 +1,152 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#include "read_files.hpp"
+
+#include <disposer/module.hpp>
+
+#include <boost/dll.hpp>
+
+#include <glob.h>
+
+
+namespace disposer_module::load_directory{
+
+
+	using namespace disposer;
+	using namespace disposer::literals;
+	namespace hana = boost::hana;
+
+
+	std::vector< std::string > scan(std::string const& pattern){
+		::glob_t list;
+		auto const error = ::glob(pattern.c_str(), GLOB_ERR, nullptr, &list);
+		if(error == GLOB_NOMATCH){
+			::globfree(&list);
+			throw std::runtime_error("no file matches '" + pattern + "'");
+		}
+
+		if(error != 0){
+			::globfree(&list);
+			throw std::runtime_error("can not scan '" + pattern + "'");
+		}
+
+		// glob sorts the entries
+		std::vector< std::string > result(
+			list.gl_pathv, list.gl_pathv + list.gl_pathc);
+		::globfree(&list);
+		return result;
+	}
+
+
+	struct state{
+		std::vector< std::string > filenames;
+		std::unique_ptr< read_state > reader;
+	};
+
+
+	void init(std::string const& name, declarant& disposer){
+		auto init = generate_module(
+			"load files from hard disk, the filenames are found once at "
+			"initialization by a glob pattern and sorted, the exec ID is the "
+			"index in the sorted list",
+			module_configure(
+				make("pattern"_param, free_type_c< std::string >,
+					"glob pattern of the files (e.g. 'data/*.png'), the path "
+					"is treated as part of the pattern"),
+				make("backend"_param, free_type_c< read_backend >,
+					read_backend_description,
+					parser_fn([](std::string_view data){
+						return parse_enum< read_backend >(
+							data, read_backend_list);
+					}),
+					default_value(read_backend::iostream)),
+				make("cache_mode"_param, free_type_c< cache_mode >,
+					cache_mode_description,
+					parser_fn([](std::string_view data){
+						return parse_enum< cache_mode >(
+							data, cache_mode_list);
+					}),
+					default_value(cache_mode::cached)),
+				make("compression"_param, free_type_c< compression >,
+					"codec the files are compressed with, they are "
+					"decompressed after reading (none, lz4, zstd)",
+					parser_fn([](std::string_view data){
+						return parse_enum< compression >(
+							data, compression_list);
+					}),
+					default_value(compression::none)),
+				make("fixed_id"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"used instead of the exec ID if set"),
+				make("id_modulo"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"ID is exec ID modulo id_modulo if set"),
+				make("subid_count"_param, free_type_c< std::size_t >,
+					"count of files per exec, the files of an ID start at "
+					"index ID * subid_count",
+					default_value(1),
+					verify_value_fn([](std::size_t value){
+						if(value == 0){
+							throw std::logic_error("must be greater 0");
+						}
+					})),
+				make("content"_out, free_type_c< std::string >,
+					"the loaded data")
+			),
+			module_init_fn([](auto const module){
+				auto const pattern = module("pattern"_param);
+				state result{scan(pattern),
+					make_read_state(module, module("backend"_param),
+						module("cache_mode"_param),
+						module("compression"_param))};
+				module.log([&result, &pattern](logsys::stdlogb& os){
+						os << "pattern '" << pattern << "' matches "
+							<< result.filenames.size() << " files";
+					});
+				return result;
+			}),
+			exec_fn([](auto module){
+				auto id = module.id();
+
+				auto fixed_id = module("fixed_id"_param);
+				if(fixed_id) id = *fixed_id;
+
+				auto const id_modulo = module("id_modulo"_param);
+				if(id_modulo) id %= *id_modulo;
+
+				auto const subid_count = module("subid_count"_param);
+
+				auto& state = module.state();
+				auto const first = id * subid_count;
+				if(first + subid_count > state.filenames.size()){
+					throw std::out_of_range("ID " + std::to_string(id)
+						+ " needs files up to index "
+						+ std::to_string(first + subid_count - 1)
+						+ " but pattern matches only "
+						+ std::to_string(state.filenames.size()) + " files");
+				}
+
+				auto const begin = state.filenames.begin() + first;
+				auto data = read_files(module, *state.reader,
+					std::vector< std::string >(begin, begin + subid_count));
+
+				auto& out = module("content"_out);
+				for(auto& content: data){
+					out.push(std::move(content));
+				}
+			})
+		);
+
+		init(name, disposer);
+	}
+
+	BOOST_DLL_AUTO_ALIAS(init)
+
+
+}
@@ -0,0 +1,321 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#include "read_files.hpp"
+
+#include <disposer/module.hpp>
+
+#include <boost/dll.hpp>
+
+#include <condition_variable>
+#include <system_error>
+#include <thread>
+#include <chrono>
+#include <deque>
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+namespace disposer_module::load_hot_folder{
+
+
+	using namespace disposer;
+	using namespace disposer::literals;
+	namespace hana = boost::hana;
+
+
+	enum class overflow{
+		drop_oldest,
+		block
+	};
+
+	constexpr std::array< std::string_view, 2 > overflow_list{{
+			"drop_oldest",
+			"block"
+		}};
+
+	std::string to_string(overflow const policy){
+		return std::string(
+			overflow_list.at(static_cast< std::size_t >(policy)));
+	}
+
+
+	class hot_folder{
+	public:
+		hot_folder(
+			std::string directory,
+			std::size_t queue_size,
+			overflow policy
+		)
+			: directory_(std::move(directory))
+			, queue_size_(queue_size)
+			, policy_(policy)
+			, inotify_fd_(::inotify_init1(IN_CLOEXEC))
+			, event_fd_(::eventfd(0, EFD_CLOEXEC))
+		{
+			if(inotify_fd_ < 0 || event_fd_ < 0){
+				close_fds();
+				throw std::system_error(errno, std::system_category(),
+					"create inotify instance");
+			}
+
+			// IN_MOVED_TO catches writers that rename finished files into
+			// the directory
+			if(::inotify_add_watch(inotify_fd_, directory_.c_str(),
+				IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0
+			){
+				close_fds();
+				throw std::system_error(errno, std::system_category(),
+					"watch directory '" + directory_ + "'");
+			}
+
+			thread_ = std::thread([this]{ run(); });
+		}
+
+		hot_folder(hot_folder const&) = delete;
+
+		~hot_folder(){
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				stop_ = true;
+			}
+			not_full_.notify_all();
+			not_empty_.notify_all();
+
+			std::uint64_t const value = 1;
+			if(::write(event_fd_, &value, sizeof(value)) < 0){
+				// the thread still wakes up on the next inotify event
+			}
+
+			thread_.join();
+			close_fds();
+		}
+
+
+		/// \brief The oldest queued file, empty after timeout or stop
+		std::optional< std::string > pop(std::chrono::milliseconds timeout){
+			std::unique_lock< std::mutex > lock(mutex_);
+			auto const ready = [this]{
+					return !queue_.empty() || error_ || stop_;
+				};
+
+			if(!not_empty_.wait_for(lock, timeout, ready)) return {};
+
+			if(queue_.empty()){
+				if(stop_) return {};
+				std::rethrow_exception(error_);
+			}
+
+			auto filename = std::move(queue_.front());
+			queue_.pop_front();
+			lock.unlock();
+			not_full_.notify_one();
+			return filename;
+		}
+
+		std::size_t exchange_dropped(){
+			std::lock_guard< std::mutex > lock(mutex_);
+			return std::exchange(dropped_, 0);
+		}
+
+
+	private:
+		void run(){
+			try{
+				alignas(::inotify_event) char buffer[4096];
+				::pollfd fds[2] = {
+						{inotify_fd_, POLLIN, 0},
+						{event_fd_, POLLIN, 0}
+					};
+
+				for(;;){
+					if(::poll(fds, 2, -1) < 0){
+						if(errno == EINTR) continue;
+						throw std::system_error(errno, std::system_category(),
+							"poll inotify");
+					}
+
+					if(fds[1].revents) return;
+
+					auto const size = ::read(inotify_fd_, buffer,
+						sizeof(buffer));
+					if(size < 0){
+						if(errno == EINTR || errno == EAGAIN) continue;
+						throw std::system_error(errno, std::system_category(),
+							"read inotify");
+					}
+
+					for(auto pos = buffer; pos < buffer + size;){
+						auto const& event =
+							*reinterpret_cast< ::inotify_event* >(pos);
+						pos += sizeof(::inotify_event) + event.len;
+
+						if(event.mask & IN_Q_OVERFLOW){
+							std::lock_guard< std::mutex > lock(mutex_);
+							++dropped_;
+							continue;
+						}
+
+						if(event.len == 0 || (event.mask & IN_ISDIR)){
+							continue;
+						}
+
+						if(!push(directory_ + "/" + event.name)) return;
+					}
+				}
+			}catch(...){
+				{
+					std::lock_guard< std::mutex > lock(mutex_);
+					error_ = std::current_exception();
+				}
+				not_empty_.notify_all();
+			}
+		}
+
+		bool push(std::string&& filename){
+			{
+				std::unique_lock< std::mutex > lock(mutex_);
+				if(queue_.size() >= queue_size_){
+					if(policy_ == overflow::drop_oldest){
+						queue_.pop_front();
+						++dropped_;
+					}else{
+						not_full_.wait(lock, [this]{
+								return queue_.size() < queue_size_ || stop_;
+							});
+						if(stop_) return false;
+					}
+				}
+
+				queue_.push_back(std::move(filename));
+			}
+			not_empty_.notify_one();
+			return true;
+		}
+
+		void close_fds()noexcept{
+			if(inotify_fd_ >= 0) ::close(inotify_fd_);
+			if(event_fd_ >= 0) ::close(event_fd_);
+		}
+
+
+		std::string const directory_;
+		std::size_t const queue_size_;
+		overflow const policy_;
+
+		int const inotify_fd_;
+		int const event_fd_;
+
+		std::mutex mutex_;
+		std::condition_variable not_empty_;
+		std::condition_variable not_full_;
+		std::deque< std::string > queue_;
+		std::size_t dropped_ = 0;
+		std::exception_ptr error_;
+		bool stop_ = false;
+
+		std::thread thread_;
+	};
+
+
+	void init(std::string const& name, declarant& disposer){
+		auto init = generate_module(
+			"watch a directory via inotify and load every file as soon as "
+			"it is completely written (closed after write or moved into the "
+			"directory), every exec loads the oldest queued file",
+			module_configure(
+				make("directory"_param, free_type_c< std::string >,
+					"the watched directory"),
+				make("queue_size"_param, free_type_c< std::size_t >,
+					"maximal count of queued filenames",
+					default_value(64),
+					verify_value_fn([](std::size_t value){
+						if(value == 0){
+							throw std::logic_error("must be greater 0");
+						}
+					})),
+				make("overflow"_param, free_type_c< overflow >,
+					"behavior if the queue is full:\n"
+					"* drop_oldest => the oldest queued file is skipped\n"
+					"* block => stop reading inotify events until an exec "
+					"takes a file, the kernel queues the events meanwhile",
+					parser_fn([](std::string_view data){
+						return parse_enum< overflow >(data, overflow_list);
+					}),
+					default_value(overflow::drop_oldest)),
+				make("timeout_in_ms"_param, free_type_c< std::size_t >,
+					"maximal wait time for a file per exec, nothing is loaded "
+					"if no file arrives in this time; a chain shutdown waits "
+					"for the running exec, so it takes up to this time",
+					default_value(1000)),
+				make("cache_mode"_param, free_type_c< cache_mode >,
+					cache_mode_description,
+					parser_fn([](std::string_view data){
+						return parse_enum< cache_mode >(
+							data, cache_mode_list);
+					}),
+					default_value(cache_mode::cached)),
+				make("compression"_param, free_type_c< compression >,
+					"codec the files are compressed with, they are "
+					"decompressed after reading (none, lz4, zstd)",
+					parser_fn([](std::string_view data){
+						return parse_enum< compression >(
+							data, compression_list);
+					}),
+					default_value(compression::none)),
+				make("content"_out, free_type_c< std::string >,
+					"the loaded data")
+			),
+			module_init_fn([](auto const module){
+				return std::make_unique< hot_folder >(
+					module("directory"_param),
+					module("queue_size"_param),
+					module("overflow"_param));
+			}),
+			exec_fn([](auto module){
+				auto& folder = *module.state();
+
+				auto const filename = folder.pop(
+					std::chrono::milliseconds(module("timeout_in_ms"_param)));
+
+				auto const dropped = folder.exchange_dropped();
+				if(dropped > 0){
+					module.log([dropped](logsys::stdlogb& os){
+							os << "queue overflow, dropped " << dropped
+								<< " files";
+						});
+				}
+
+				if(!filename){
+					module.log([](logsys::stdlogb& os){
+							os << "no file within timeout";
+						});
+					return;
+				}
+
+				module("content"_out).push(
+					module.log([&filename](logsys::stdlogb& os){
+							os << *filename;
+						}, [module, &filename]{
+							return decompress(module("compression"_param),
+								read_file(*filename,
+									module("cache_mode"_param)));
+						}));
+			})
+		);
+
+		init(name, disposer);
+	}
+
+	BOOST_DLL_AUTO_ALIAS(init)
+
+
+}
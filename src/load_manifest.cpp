@@ -0,0 +1,318 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#include "compression.hpp"
+#include "file_descriptor.hpp"
+#include "parse_enum.hpp"
+
+#include <disposer/module.hpp>
+
+#include <io_tools/range_to_string.hpp>
+
+#include <boost/dll.hpp>
+
+#include <unordered_map>
+#include <charconv>
+#include <fstream>
+#include <tuple>
+#include <mutex>
+#include <map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace disposer_module::load_manifest{
+
+
+	using namespace disposer;
+	using namespace disposer::literals;
+	namespace hana = boost::hana;
+
+
+	using t1 = std::string;
+	using t2 = std::vector< std::string >;
+	using t3 = std::vector< std::vector< std::string > >;
+
+	constexpr std::array< std::string_view, 3 > list{{
+			"file",
+			"file_list",
+			"file_list_list"
+		}};
+
+	constexpr auto dim = dimension_c<
+			std::string,
+			std::vector< std::string >,
+			std::vector< std::vector< std::string > >
+		>;
+
+	std::string format_description(){
+		static_assert(dim.type_count == list.size());
+		std::ostringstream os;
+		std::size_t i = 0;
+		hana::for_each(dim.types, [&os, &i](auto t){
+				os << "\n* " << list[i] << " => "
+					<< ct_pretty_name< typename decltype(t)::type >();
+				++i;
+			});
+		return os.str();
+	}
+
+
+	struct record{
+		std::string file;
+		std::size_t offset;
+		std::size_t size;
+	};
+
+	/// \brief sub ID, i and j, missing dimensions are 0
+	using position = std::tuple< std::size_t, std::size_t, std::size_t >;
+
+	/// \brief Records by ID, ordered by position
+	using index = std::unordered_map< std::size_t,
+		std::map< position, record > >;
+
+
+	std::vector< std::string_view > split(std::string_view line){
+		std::vector< std::string_view > result;
+		for(;;){
+			auto const pos = line.find('\t');
+			result.push_back(line.substr(0, pos));
+			if(pos == std::string_view::npos) return result;
+			line.remove_prefix(pos + 1);
+		}
+	}
+
+	index read_manifest(std::string const& filename){
+		std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+		if(!is){
+			throw std::runtime_error("Can not open file '" + filename + "'");
+		}
+
+		index result;
+		std::string line;
+		for(std::size_t number = 1; std::getline(is, line); ++number){
+			if(line.empty() || line[0] == '#') continue;
+
+			auto const error = [&filename, number](std::string const& text){
+					return std::runtime_error("manifest '" + filename
+						+ "' line " + std::to_string(number) + ": " + text);
+				};
+
+			auto const fields = split(line);
+			if(fields.size() != 8){
+				throw error("expected 8 tab separated fields");
+			}
+
+			auto const value = [&fields, &error](std::size_t i){
+					std::size_t result = 0;
+					auto const field = fields[i];
+					if(field.empty()) return result;
+
+					auto const [end, ec] = std::from_chars(
+						field.data(), field.data() + field.size(), result);
+					if(ec != std::errc() || end != field.data() + field.size()){
+						throw error("field " + std::to_string(i + 1)
+							+ " is not a number");
+					}
+					return result;
+				};
+
+			// a later record replaces an earlier one at the same position
+			result[value(0)][position(value(1), value(2), value(3))] =
+				record{std::string(fields[4]), value(5), value(6)};
+		}
+
+		return result;
+	}
+
+
+	/// \brief Reads records, keeps the last file open for archives
+	class reader{
+	public:
+		std::string read(record const& entry){
+			if(entry.file != filename_){
+				filename_.clear();
+				fd_.reset(::open(entry.file.c_str(), O_RDONLY | O_CLOEXEC));
+				if(fd_.get() < 0){
+					throw std::runtime_error("Can not open file '"
+						+ entry.file + "'");
+				}
+				filename_ = entry.file;
+			}
+
+			std::string result(entry.size, '\0');
+			std::size_t done = 0;
+			while(done < entry.size){
+				auto const count = ::pread(fd_.get(), result.data() + done,
+					entry.size - done, entry.offset + done);
+				if(count < 0){
+					if(errno == EINTR) continue;
+					throw std::runtime_error("Can not read file '"
+						+ entry.file + "'");
+				}
+				if(count == 0){
+					throw std::runtime_error("file '" + entry.file
+						+ "' is smaller than its manifest record");
+				}
+				done += static_cast< std::size_t >(count);
+			}
+
+			return result;
+		}
+
+
+	private:
+		std::string filename_;
+		file_descriptor fd_;
+	};
+
+
+	struct state{
+		index const records;
+
+		std::mutex mutex;
+		reader file_reader;
+	};
+
+
+	void init(std::string const& name, declarant& disposer){
+		auto init = generate_module(
+			"load files by the manifest of module save, the records of an "
+			"exec ID are found without formatting or searching file names, "
+			"files in tar archives are read at their offset",
+			dimension_list{
+				dim
+			},
+			module_configure(
+				make("manifest"_param, free_type_c< std::string >,
+					"the manifest file written by module save"),
+				make("type"_param, free_type_c< std::size_t >,
+					"set dimension 1 by value:" + format_description()
+					+ "\nevery sub ID of the exec ID gives one output value, "
+					"i and j of the records number the vectors",
+					parser_fn([](std::string_view data){
+						auto iter = std::find(list.begin(), list.end(), data);
+						if(iter == list.end()){
+							throw std::runtime_error("unknown value '"
+								+ std::string(data)
+								+ "', valid values are: "
+								+ io_tools::range_to_string(list));
+						}
+						return iter - list.begin();
+					}),
+					default_value(0)),
+				make("compression"_param, free_type_c< compression >,
+					"codec the files are compressed with, they are "
+					"decompressed after reading (none, lz4, zstd)",
+					parser_fn([](std::string_view data){
+						return parse_enum< compression >(
+							data, compression_list);
+					}),
+					default_value(compression::none)),
+				make("fixed_id"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"used instead of the exec ID if set"),
+				make("id_modulo"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"ID is exec ID modulo id_modulo if set"),
+				set_dimension_fn([](auto const module){
+					std::size_t const number = module("type"_param);
+					return solved_dimensions{index_component< 0 >{number}};
+				}),
+				make("content"_out, type_ref_c< 0 >,
+					"the loaded data")
+			),
+			module_init_fn([](auto const module){
+				auto const filename = module("manifest"_param);
+				std::unique_ptr< state > result(
+					new state{read_manifest(filename), {}, {}});
+				module.log([&filename, &result](logsys::stdlogb& os){
+						os << "manifest '" << filename << "' contains "
+							<< result->records.size() << " IDs";
+					});
+				return result;
+			}),
+			exec_fn([](auto module){
+				auto id = module.id();
+
+				auto fixed_id = module("fixed_id"_param);
+				if(fixed_id) id = *fixed_id;
+
+				auto const id_modulo = module("id_modulo"_param);
+				if(id_modulo) id %= *id_modulo;
+
+				auto& state = *module.state();
+				auto const iter = state.records.find(id);
+				if(iter == state.records.end()){
+					throw std::out_of_range("ID " + std::to_string(id)
+						+ " is not in the manifest");
+				}
+
+				auto const codec = module("compression"_param);
+				auto const read = [module, &state, codec](record const& r){
+						return module.log([&r](logsys::stdlogb& os){
+								os << r.file << " at offset " << r.offset;
+							}, [&state, codec, &r]{
+								auto data = [&state, &r]{
+										std::lock_guard< std::mutex >
+											lock(state.mutex);
+										return state.file_reader.read(r);
+									}();
+								return decompress(codec, std::move(data));
+							});
+					};
+
+				using type = typename
+					decltype(module.dimension(hana::size_c< 0 >))::type;
+
+				auto& out = module("content"_out);
+				if constexpr(std::is_same_v< type, t1 >){
+					for(auto const& [pos, entry]: iter->second){
+						out.push(read(entry));
+					}
+				}else if constexpr(std::is_same_v< type, t2 >){
+					t2 value;
+					std::optional< std::size_t > subid;
+					for(auto const& [pos, entry]: iter->second){
+						if(subid && std::get< 0 >(pos) != *subid){
+							out.push(std::move(value));
+							value.clear();
+						}
+						subid = std::get< 0 >(pos);
+						value.push_back(read(entry));
+					}
+					if(subid) out.push(std::move(value));
+				}else if constexpr(std::is_same_v< type, t3 >){
+					t3 value;
+					std::optional< std::pair< std::size_t, std::size_t > > last;
+					for(auto const& [pos, entry]: iter->second){
+						auto const subid = std::get< 0 >(pos);
+						auto const i = std::get< 1 >(pos);
+						if(last && last->first != subid){
+							out.push(std::move(value));
+							value.clear();
+						}
+						if(!last || last->first != subid || last->second != i){
+							value.emplace_back();
+						}
+						last = std::make_pair(subid, i);
+						value.back().push_back(read(entry));
+					}
+					if(last) out.push(std::move(value));
+				}
+			})
+		);
+
+		init(name, disposer);
+	}
+
+	BOOST_DLL_AUTO_ALIAS(init)
+
+
+}
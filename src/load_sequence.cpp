@@ -0,0 +1,192 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2017-2018 Benjamin Buch
+//
+// https://github.com/bebuch/disposer_module
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+//-----------------------------------------------------------------------------
+#include <disposer/module.hpp>
+
+#include <boost/dll.hpp>
+
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace disposer_module::load_sequence{
+
+
+	using namespace disposer;
+	using namespace disposer::literals;
+	namespace hana = boost::hana;
+
+
+	class mapped_file{
+	public:
+		mapped_file(std::string const& filename){
+			auto const fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+			if(fd < 0){
+				throw std::system_error(errno, std::system_category(),
+					"Can not open file '" + filename + "'");
+			}
+
+			struct ::stat stat;
+			if(::fstat(fd, &stat) < 0){
+				auto const error = errno;
+				::close(fd);
+				throw std::system_error(error, std::system_category(),
+					"Can not stat file '" + filename + "'");
+			}
+			size_ = static_cast< std::size_t >(stat.st_size);
+
+			if(size_ == 0){
+				::close(fd);
+				return;
+			}
+
+			data_ = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+			auto const error = errno;
+			::close(fd);
+
+			if(data_ == MAP_FAILED){
+				throw std::system_error(error, std::system_category(),
+					"Can not map file '" + filename + "'");
+			}
+		}
+
+		mapped_file(mapped_file const&) = delete;
+
+		~mapped_file(){
+			if(data_ != MAP_FAILED) ::munmap(data_, size_);
+		}
+
+
+		char const* data()const{
+			return static_cast< char const* >(data_);
+		}
+
+		std::size_t size()const{
+			return size_;
+		}
+
+
+	private:
+		void* data_ = MAP_FAILED;
+		std::size_t size_ = 0;
+	};
+
+
+	void init(std::string const& name, declarant& disposer){
+		auto expect_greater_0 =
+			verify_value_fn([](std::size_t value){
+				if(value == 0){
+					throw std::logic_error("must be greater 0");
+				}
+			});
+
+		auto init = generate_module(
+			"load fixed size frames from one large raw sequence file, the "
+			"file is mapped into memory once and frame ID starts at offset "
+			"header_size + ID * frame_size",
+			module_configure(
+				make("filename"_param, free_type_c< std::string >,
+					"the sequence file"),
+				make("header_size"_param, free_type_c< std::size_t >,
+					"bytes before the first frame",
+					default_value(0)),
+				make("frame_size"_param, free_type_c< std::size_t >,
+					"bytes per frame",
+					expect_greater_0),
+				make("fixed_id"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"used instead of the exec ID if set"),
+				make("id_modulo"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"ID is exec ID modulo id_modulo if set"),
+				make("subid_count"_param, free_type_c< std::size_t >,
+					"count of frames per exec, the frames of an ID start at "
+					"frame ID * subid_count",
+					default_value(1),
+					expect_greater_0),
+				make("content"_out, free_type_c< std::string >,
+					"the loaded frame")
+			),
+			module_init_fn([](auto const module){
+				auto const filename = module("filename"_param);
+				auto const header_size = module("header_size"_param);
+				auto const frame_size = module("frame_size"_param);
+
+				auto file = std::make_unique< mapped_file >(filename);
+				if(file->size() < header_size){
+					throw std::runtime_error("file '" + filename
+						+ "' is smaller than header_size");
+				}
+
+				auto const frame_count =
+					(file->size() - header_size) / frame_size;
+				module.log([&filename, frame_count](logsys::stdlogb& os){
+						os << "file '" << filename << "' contains "
+							<< frame_count << " frames";
+					});
+
+				// frames are usually replayed in order
+				if(file->size() > 0){
+					::madvise(const_cast< char* >(file->data()), file->size(),
+						MADV_SEQUENTIAL);
+				}
+
+				return file;
+			}),
+			exec_fn([](auto module){
+				auto id = module.id();
+
+				auto fixed_id = module("fixed_id"_param);
+				if(fixed_id) id = *fixed_id;
+
+				auto const id_modulo = module("id_modulo"_param);
+				if(id_modulo) id %= *id_modulo;
+
+				auto const subid_count = module("subid_count"_param);
+				auto const header_size = module("header_size"_param);
+				auto const frame_size = module("frame_size"_param);
+
+				auto const& file = *module.state();
+				auto const frame_count =
+					(file.size() - header_size) / frame_size;
+
+				auto& out = module("content"_out);
+				for(std::size_t subid = 0; subid < subid_count; ++subid){
+					auto const frame = id * subid_count + subid;
+					out.push(module.log([frame](logsys::stdlogb& os){
+							os << "frame " << frame;
+						}, [&file, frame, frame_count, header_size,
+							frame_size
+						]{
+							if(frame >= frame_count){
+								throw std::out_of_range("frame "
+									+ std::to_string(frame)
+									+ " does not exist, file contains "
+									+ std::to_string(frame_count)
+									+ " frames");
+							}
+
+							auto const begin =
+								file.data() + header_size + frame * frame_size;
+							return std::string(begin, frame_size);
+						}));
+				}
+			})
+		);
+
+		init(name, disposer);
+	}
+
+	BOOST_DLL_AUTO_ALIAS(init)
+
+
+}
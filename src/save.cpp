@@ -6,16 +6,41 @@
 // Distributed under the Boost Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
 //-----------------------------------------------------------------------------
+#include "async_queue.hpp"
+#include "compression.hpp"
+#include "file_descriptor.hpp"
+#include "io_uring.hpp"
+#include "parse_enum.hpp"
+#include "thread_pool.hpp"
+#include "xxhash64.hpp"
+
 #include <disposer/module.hpp>
 
 #include <io_tools/name_generator.hpp>
 #include <io_tools/time_to_dir_string.hpp>
+#include <io_tools/range_to_string.hpp>
+
+#include <logsys/log.hpp>
 
 #include <boost/filesystem.hpp>
 
 #include <boost/dll.hpp>
 
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <ctime>
+#include <set>
+#include <map>
+#include <atomic>
+#include <deque>
+#include <iterator>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 
 namespace disposer_module::save{
@@ -88,83 +113,341 @@ namespace disposer_module::save{
 		throw std::runtime_error("Can not write to file '" + filename + "'");
 	}
 
-	template < typename Module >
-	void save(
-		Module const module,
+
+	struct job{
+		std::string filename;
+		std::string data;
+		std::size_t id;
+		std::size_t subid;
+		std::optional< std::size_t > i;
+		std::optional< std::size_t > j;
+	};
+
+	file_descriptor write(job const& job){
+		file_descriptor fd(::open(job.filename.c_str(),
+			O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+		if(fd.get() < 0){
+			throw std::runtime_error("Can not open file '" + job.filename
+				+ "' for write");
+		}
+
+		std::size_t done = 0;
+		while(done < job.data.size()){
+			auto const count = ::write(fd.get(), job.data.data() + done,
+				job.data.size() - done);
+			if(count < 0){
+				if(errno == EINTR) continue;
+				throw std::runtime_error("Can not write to file '"
+					+ job.filename + "'");
+			}
+			done += static_cast< std::size_t >(count);
+		}
+
+		return fd;
+	}
+
+	/// \brief Write files with batched io_uring submissions
+	///
+	/// All files are opened in one submission. The next submission
+	/// preallocates every file to its final size and then writes it, short
+	/// writes are continued in further submissions. A last submission
+	/// closes the files, unless keep_open is set.
+	std::vector< file_descriptor > write(
+		io_uring& ring,
+		std::vector< job > const& jobs,
+		bool keep_open
+	){
+		// a single io_uring write is limited like write(2)
+		constexpr std::size_t max_write_size = std::size_t(1) << 30;
+
+		auto const count = jobs.size();
+		for(auto const& job: jobs){
+			ring.openat(AT_FDCWD, job.filename.c_str(),
+				O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		}
+		auto const opened = ring.submit();
+
+		std::vector< file_descriptor > fds;
+		fds.reserve(count);
+		for(auto const fd: opened){
+			fds.emplace_back(fd);
+		}
+
+		auto const close_all = [&ring, &fds]{
+			for(auto& fd: fds){
+				if(fd.get() >= 0) ring.close(fd.release());
+			}
+			ring.submit();
+		};
+
+		std::vector< std::size_t > pending;
+		pending.reserve(count);
+		for(std::size_t i = 0; i < count; ++i){
+			if(fds[i].get() < 0){
+				close_all();
+				throw std::runtime_error("Can not open file '"
+					+ jobs[i].filename + "' for write");
+			}
+
+			if(!jobs[i].data.empty()) pending.push_back(i);
+		}
+
+		std::vector< std::size_t > done(count, 0);
+		for(bool first = true; !pending.empty(); first = false){
+			std::vector< std::size_t > ops;
+			ops.reserve(pending.size());
+			for(auto const i: pending){
+				auto const& data = jobs[i].data;
+
+				// the result is ignored, preallocation is only a hint and
+				// not every file system supports it; the write is linked,
+				// so it starts after the preallocation also on failure
+				if(first){
+					ring.fallocate(fds[i].get(), 0, 0, data.size(),
+						io_uring::link_next);
+				}
+
+				auto const size = std::min(data.size() - done[i],
+					max_write_size);
+				ops.push_back(ring.write(fds[i].get(), data.data() + done[i],
+					static_cast< std::uint32_t >(size), done[i]));
+			}
+			auto const written = ring.submit();
+
+			std::vector< std::size_t > next;
+			for(std::size_t k = 0; k < pending.size(); ++k){
+				auto const i = pending[k];
+				auto const result = written[ops[k]];
+				if(result <= 0){
+					close_all();
+					throw std::runtime_error("Can not write to file '"
+						+ jobs[i].filename + "'");
+				}
+
+				done[i] += static_cast< std::size_t >(result);
+				if(done[i] < jobs[i].data.size()) next.push_back(i);
+			}
+			pending = std::move(next);
+		}
+
+		if(!keep_open) close_all();
+		return fds;
+	}
+
+	file_descriptor open_for_sync(std::string const& filename){
+		file_descriptor fd(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+		if(fd.get() >= 0) return fd;
+		throw std::runtime_error("Can not open file '" + filename
+			+ "' for sync");
+	}
+
+	void sync_file(int fd, std::string const& filename){
+		if(::fdatasync(fd) == 0) return;
+		throw std::runtime_error("Can not sync file '" + filename + "'");
+	}
+
+	void sync_directory(std::string const& path){
+		file_descriptor fd(::open(path.empty() ? "." : path.c_str(),
+			O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+		if(fd.get() >= 0 && ::fsync(fd.get()) == 0) return;
+		throw std::runtime_error("Can not sync directory '" + path + "'");
+	}
+
+
+	enum class durability{
+		none,
+		group,
+		per_file
+	};
+
+	constexpr std::array< std::string_view, 3 > durability_list{{
+			"none",
+			"group",
+			"per_file"
+		}};
+
+	std::string to_string(durability const mode){
+		return std::string(
+			durability_list.at(static_cast< std::size_t >(mode)));
+	}
+
+
+	enum class write_backend{
+		posix,
+		io_uring
+	};
+
+	constexpr std::array< std::string_view, 2 > write_backend_list{{
+			"posix",
+			"io_uring"
+		}};
+
+	std::string to_string(write_backend const backend){
+		return std::string(
+			write_backend_list.at(static_cast< std::size_t >(backend)));
+	}
+
+
+	/// \brief Syncs written files and their directories in batches
+	///
+	/// A batch is committed when it contains max_files files or, if
+	/// interval is set, periodically by a background thread.
+	class group_commit{
+	public:
+		group_commit(
+			std::size_t max_files,
+			std::optional< std::chrono::milliseconds > interval
+		)
+			: max_files_(max_files)
+		{
+			if(!interval) return;
+
+			thread_ = std::thread([this, interval = *interval]{
+					std::unique_lock< std::mutex > lock(mutex_);
+					while(!stop_){
+						if(stop_cv_.wait_for(lock, interval,
+							[this]{ return stop_; })) return;
+
+						lock.unlock();
+						try{
+							commit();
+						}catch(...){
+							std::lock_guard< std::mutex > lock(mutex_);
+							if(!error_) error_ = std::current_exception();
+						}
+						lock.lock();
+					}
+				});
+		}
+
+		group_commit(group_commit const&) = delete;
+
+		~group_commit(){
+			if(thread_.joinable()){
+				{
+					std::lock_guard< std::mutex > lock(mutex_);
+					stop_ = true;
+				}
+				stop_cv_.notify_all();
+				thread_.join();
+			}
+
+			logsys::exception_catching_log([](logsys::stdlogb& os){
+					os << "save final group commit";
+				}, [this]{
+					commit();
+				});
+		}
+
+
+		void add(file_descriptor&& fd, std::string const& filename){
+			std::exception_ptr error;
+			bool full = false;
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				error = std::exchange(error_, nullptr);
+				files_.push_back({std::move(fd), filename});
+				full = files_.size() >= max_files_;
+			}
+
+			if(error) std::rethrow_exception(error);
+			if(full) commit();
+		}
+
+		void commit(){
+			std::vector< file > files;
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				files.swap(files_);
+			}
+
+			// every file and directory is synced, also after a failure
+			std::vector< std::string > errors;
+			auto const try_sync = [&errors](auto const& sync){
+					try{
+						sync();
+					}catch(std::exception const& e){
+						errors.push_back(e.what());
+					}
+				};
+
+			std::set< std::string > directories;
+			for(auto const& file: files){
+				try_sync([&file]{ sync_file(file.fd.get(), file.filename); });
+				directories.insert(filesystem::path(file.filename)
+					.parent_path().string());
+			}
+
+			for(auto const& directory: directories){
+				try_sync([&directory]{ sync_directory(directory); });
+			}
+
+			if(errors.empty()) return;
+
+			std::string message = "group commit failed:";
+			for(auto const& error: errors){
+				message += "\n* " + error;
+			}
+			throw std::runtime_error(message);
+		}
+
+
+	private:
+		struct file{
+			file_descriptor fd;
+			std::string filename;
+		};
+
+		std::size_t const max_files_;
+
+		std::mutex mutex_;
+		std::condition_variable stop_cv_;
+		std::vector< file > files_;
+		std::exception_ptr error_;
+		bool stop_ = false;
+
+		std::thread thread_;
+	};
+
+
+	void add_jobs(
+		std::vector< job >& jobs,
 		std::string const& date_time,
 		std::size_t id,
 		std::size_t subid,
 		ng1 const& name,
-		std::string const& data
+		std::string&& data
 	){
-		auto const filename = name(date_time, id, subid);
-
-		module.log([&filename](logsys::stdlogb& os){
-				os << filename;
-			}, [&filename, &data]{
-				filesystem::create_directories(
-					filesystem::path(filename).remove_filename());
-
-				std::ofstream os(filename.c_str(),
-					std::ios::out | std::ios::binary);
-				verify_open(os, filename);
-				os.write(data.data(), data.size());
-				verify_write(os, filename);
-			});
+		jobs.push_back({name(date_time, id, subid), std::move(data),
+			id, subid, {}, {}});
 	}
 
-	template < typename Module >
-	void save(
-		Module const module,
+	void add_jobs(
+		std::vector< job >& jobs,
 		std::string const& date_time,
 		std::size_t id,
 		std::size_t subid,
 		ng2 const& name,
-		std::vector< std::string > const& data
+		std::vector< std::string >&& data
 	){
 		for(std::size_t i = 0; i < data.size(); ++i){
-			auto const filename = name(date_time, id, subid, i);
-
-			module.log([&filename](logsys::stdlogb& os){
-					os << filename;
-				}, [&filename, &data, i]{
-					filesystem::create_directories(
-						filesystem::path(filename).remove_filename());
-
-					std::ofstream os(filename.c_str(),
-						std::ios::out | std::ios::binary);
-					verify_open(os, filename);
-					os.write(data[i].data(), data[i].size());
-					verify_write(os, filename);
-				});
+			jobs.push_back({name(date_time, id, subid, i), std::move(data[i]),
+				id, subid, i, {}});
 		}
 	}
 
-	template < typename Module >
-	void save(
-		Module const module,
+	void add_jobs(
+		std::vector< job >& jobs,
 		std::string const& date_time,
 		std::size_t id,
 		std::size_t subid,
 		ng3 const& name,
-		std::vector< std::vector< std::string > > const& data
+		std::vector< std::vector< std::string > >&& data
 	){
 		for(std::size_t i = 0; i < data.size(); ++i){
-			for(std::size_t j = 0; j < data.size(); ++j){
-				auto const filename = name(date_time, id, subid, i, j);
-
-				module.log([&filename](logsys::stdlogb& os){
-						os << filename;
-					}, [&filename, &data, i, j]{
-						filesystem::create_directories(
-							filesystem::path(filename).remove_filename());
-
-						std::ofstream os(filename.c_str(),
-							std::ios::out | std::ios::binary);
-						verify_open(os, filename);
-						os.write(data[i][j].data(), data[i][j].size());
-						verify_write(os, filename);
-					});
+			for(std::size_t j = 0; j < data[i].size(); ++j){
+				jobs.push_back({name(date_time, id, subid, i, j),
+					std::move(data[i][j]), id, subid, i, j});
 			}
 		}
 	}
@@ -187,11 +470,723 @@ namespace disposer_module::save{
 		}
 	};
 
+	using archive_name_generator =
+		name_generator< std::string, std::size_t >;
+
+	/// \brief Appends files as members to ustar archives
+	///
+	/// A new archive is started when the current one reached max_members or
+	/// the next member would exceed max_bytes. With durability group an
+	/// archive and its directory are synced when the archive is closed,
+	/// with per_file additionally after every member.
+	class tar_archive{
+	public:
+		tar_archive(
+			archive_name_generator name,
+			std::string date_time,
+			durability mode,
+			std::optional< std::size_t > max_members,
+			std::optional< std::size_t > max_bytes
+		)
+			: name_(std::move(name))
+			, date_time_(std::move(date_time))
+			, mode_(mode)
+			, max_members_(max_members)
+			, max_bytes_(max_bytes) {}
+
+		tar_archive(tar_archive const&) = delete;
+
+		~tar_archive(){
+			logsys::exception_catching_log([this](logsys::stdlogb& os){
+					os << "close tar archive " << filename_;
+				}, [this]{
+					close();
+				});
+		}
+
+
+		/// \brief Returns the archive filename and the offset of the data
+		///
+		/// A failed write truncates the archive to its last complete member,
+		/// so later members are written behind it.
+		std::pair< std::string, std::size_t > write(job const& job){
+			auto const member_size = block_size
+				+ (job.data.size() + block_size - 1) / block_size * block_size;
+
+			std::lock_guard< std::mutex > lock(mutex_);
+			if(fd_.get() >= 0 && (
+				(max_members_ && members_ >= *max_members_) ||
+				(max_bytes_ && bytes_ + member_size > *max_bytes_)
+			)){
+				close();
+			}
+
+			if(fd_.get() < 0){
+				open();
+			}
+
+			auto const header = make_header(job.filename, job.data.size());
+			std::array< char, block_size > const padding{};
+			try{
+				write_at(header.data(), header.size(), bytes_);
+				write_at(job.data.data(), job.data.size(),
+					bytes_ + block_size);
+				write_at(padding.data(),
+					member_size - block_size - job.data.size(),
+					bytes_ + block_size + job.data.size());
+			}catch(...){
+				// without truncate the next member starts a new archive
+				if(::ftruncate(fd_.get(), static_cast< off_t >(bytes_)) != 0){
+					fd_.reset();
+				}
+				throw;
+			}
+
+			if(mode_ == durability::per_file){
+				sync_file(fd_.get(), filename_);
+			}
+
+			std::pair< std::string, std::size_t > result{
+				filename_, bytes_ + block_size};
+			++members_;
+			bytes_ += member_size;
+			return result;
+		}
+
+
+	private:
+		static constexpr std::size_t block_size = 512;
+
+		void open(){
+			filename_ = name_(date_time_, index_++);
+			filesystem::create_directories(
+				filesystem::path(filename_).remove_filename());
+
+			fd_.reset(::open(filename_.c_str(),
+				O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+			if(fd_.get() < 0){
+				throw std::runtime_error("Can not open file '" + filename_
+					+ "' for write");
+			}
+			members_ = 0;
+			bytes_ = 0;
+
+			if(mode_ == durability::per_file){
+				sync_directory(directory());
+			}
+		}
+
+		/// \brief Finish the archive, it is closed also on failure
+		void close(){
+			if(fd_.get() < 0) return;
+			auto const fd = std::move(fd_);
+
+			// end of archive are two zero blocks
+			std::array< char, 2 * block_size > const end{};
+			write_at(fd.get(), end.data(), end.size(), bytes_);
+
+			if(mode_ != durability::none){
+				sync_file(fd.get(), filename_);
+				sync_directory(directory());
+			}
+		}
+
+		std::string directory()const{
+			return filesystem::path(filename_).parent_path().string();
+		}
+
+		void write_at(char const* data, std::size_t size, std::size_t offset){
+			write_at(fd_.get(), data, size, offset);
+		}
+
+		void write_at(
+			int fd,
+			char const* data,
+			std::size_t size,
+			std::size_t offset
+		){
+			std::size_t done = 0;
+			while(done < size){
+				auto const count = ::pwrite(fd, data + done, size - done,
+					static_cast< off_t >(offset + done));
+				if(count < 0){
+					if(errno == EINTR) continue;
+					throw std::runtime_error("Can not write to file '"
+						+ filename_ + "'");
+				}
+				done += static_cast< std::size_t >(count);
+			}
+		}
+
+		static std::array< char, block_size > make_header(
+			std::string const& filename,
+			std::size_t size
+		){
+			std::array< char, block_size > header{};
+
+			auto const set = [&header](
+				std::size_t offset,
+				std::size_t length,
+				std::string_view value
+			){
+				std::copy_n(value.data(), std::min(length, value.size()),
+					header.data() + offset);
+			};
+
+			auto const octal = [&set](
+				std::size_t offset,
+				std::size_t length,
+				std::uint64_t value
+			){
+				std::ostringstream os;
+				os << std::oct << std::setw(length - 1) << std::setfill('0')
+					<< value;
+				set(offset, length - 1, os.str());
+			};
+
+			// split long names into ustar prefix and name at a slash
+			std::string_view name = filename;
+			std::string_view prefix;
+			if(name.size() > 100){
+				auto const pos = name.rfind('/', 155);
+				if(
+					pos == std::string_view::npos ||
+					name.size() - pos - 1 > 100
+				){
+					throw std::runtime_error("filename '" + filename
+						+ "' is too long for a tar archive");
+				}
+				prefix = name.substr(0, pos);
+				name = name.substr(pos + 1);
+			}
+
+			if(size > 077777777777){
+				throw std::runtime_error("file '" + filename
+					+ "' is too large for a tar archive");
+			}
+
+			set(0, 100, name);
+			octal(100, 8, 0644);
+			octal(108, 8, 0);
+			octal(116, 8, 0);
+			octal(124, 12, size);
+			octal(136, 12, static_cast< std::uint64_t >(std::time(nullptr)));
+			set(148, 8, "        ");
+			header[156] = '0';
+			set(257, 6, std::string_view("ustar", 6));
+			set(263, 2, "00");
+			set(345, 155, prefix);
+
+			std::uint32_t checksum = 0;
+			for(auto const c: header){
+				checksum += static_cast< unsigned char >(c);
+			}
+			octal(148, 7, checksum);
+			header[154] = '\0';
+
+			return header;
+		}
+
+
+		archive_name_generator const name_;
+		std::string const date_time_;
+		durability const mode_;
+		std::optional< std::size_t > const max_members_;
+		std::optional< std::size_t > const max_bytes_;
+
+		std::mutex mutex_;
+		file_descriptor fd_;
+		std::string filename_;
+		std::size_t index_ = 0;
+		std::size_t members_ = 0;
+		std::size_t bytes_ = 0;
+	};
+
+
+	/// \brief Keeps the files of the latest execs in memory
+	///
+	/// A frame holds all files of one exec. The oldest frames are dropped
+	/// when one of the limits is exceeded.
+	class flight_recorder{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		flight_recorder(
+			std::optional< std::size_t > max_frames,
+			std::optional< std::chrono::seconds > max_age,
+			std::optional< std::size_t > max_bytes
+		)
+			: max_frames_(max_frames)
+			, max_age_(max_age)
+			, max_bytes_(max_bytes) {}
+
+
+		void add(std::vector< job >&& jobs){
+			std::size_t size = 0;
+			for(auto const& job: jobs){
+				size += job.data.size();
+			}
+
+			auto const now = clock::now();
+
+			std::lock_guard< std::mutex > lock(mutex_);
+			frames_.push_back({now, std::move(jobs), size});
+			bytes_ += size;
+
+			while(!frames_.empty() && (
+				(max_frames_ && frames_.size() > *max_frames_) ||
+				(max_age_ && now - frames_.front().time > *max_age_) ||
+				(max_bytes_ && bytes_ > *max_bytes_)
+			)){
+				bytes_ -= frames_.front().bytes;
+				frames_.pop_front();
+			}
+		}
+
+		/// \brief Remove all frames, oldest files first
+		std::vector< job > take(){
+			std::deque< frame > frames;
+			{
+				std::lock_guard< std::mutex > lock(mutex_);
+				frames.swap(frames_);
+				bytes_ = 0;
+			}
+
+			std::vector< job > result;
+			for(auto& frame: frames){
+				std::move(frame.jobs.begin(), frame.jobs.end(),
+					std::back_inserter(result));
+			}
+			return result;
+		}
+
+		std::pair< std::size_t, std::size_t > size()const{
+			std::lock_guard< std::mutex > lock(mutex_);
+			return {frames_.size(), bytes_};
+		}
+
+
+	private:
+		struct frame{
+			clock::time_point time;
+			std::vector< job > jobs;
+			std::size_t bytes;
+		};
+
+		std::optional< std::size_t > const max_frames_;
+		std::optional< std::chrono::seconds > const max_age_;
+		std::optional< std::size_t > const max_bytes_;
+
+		mutable std::mutex mutex_;
+		std::deque< frame > frames_;
+		std::size_t bytes_ = 0;
+	};
+
+
+	/// \brief Remembers which files have which content
+	///
+	/// Contents are identified by their xxHash64 and their size.
+	class deduplicator{
+	public:
+		using key = std::pair< std::uint64_t, std::size_t >;
+
+		static key make_key(std::string const& data){
+			return {xxhash64(data), data.size()};
+		}
+
+
+		/// \brief Serializes all writes of one filename
+		class file_lock{
+		public:
+			file_lock(deduplicator& dedup, std::string const& filename)
+				: dedup_(dedup)
+				, filename_(filename)
+			{
+				std::unique_lock< std::mutex > lock(dedup_.mutex_);
+				dedup_.cv_.wait(lock, [this]{
+						return dedup_.busy_.count(filename_) == 0;
+					});
+				dedup_.busy_.insert(filename_);
+			}
+
+			file_lock(file_lock const&) = delete;
+
+			~file_lock(){
+				{
+					std::lock_guard< std::mutex > lock(dedup_.mutex_);
+					dedup_.busy_.erase(filename_);
+				}
+				dedup_.cv_.notify_all();
+			}
+
+		private:
+			deduplicator& dedup_;
+			std::string const filename_;
+		};
+
+
+		/// \brief Make filename a hardlink to a file with the same content
+		///
+		/// Returns true if filename has the content afterwards. Otherwise
+		/// filename is removed and the caller writes and inserts it. The
+		/// lookup, the unlink and the link are one step under the mutex, so
+		/// no other thread can replace the linked file in between.
+		bool replace(key const& key, std::string const& filename){
+			std::lock_guard< std::mutex > lock(mutex_);
+			auto const iter = keys_.find(filename);
+			if(iter != keys_.end() && iter->second == key) return true;
+
+			if(::unlink(filename.c_str()) < 0 && errno != ENOENT){
+				throw std::runtime_error("Can not replace file '"
+					+ filename + "'");
+			}
+			erase(filename);
+
+			// on failure (e.g. across file systems) the file is written
+			auto const files = files_.find(key);
+			if(files == files_.end() || ::link(
+				files->second.begin()->c_str(), filename.c_str()) != 0
+			) return false;
+
+			files->second.insert(filename);
+			keys_.emplace(filename, key);
+			return true;
+		}
+
+		/// \brief Add a written file, requires a replace before
+		void insert(key const& key, std::string const& filename){
+			std::lock_guard< std::mutex > lock(mutex_);
+			files_[key].insert(filename);
+			keys_.emplace(filename, key);
+		}
+
+		void count(bool hit, std::size_t bytes){
+			++files;
+			if(!hit) return;
+			++hits;
+			saved_bytes += bytes;
+		}
+
+
+		std::atomic< std::size_t > files{0};
+		std::atomic< std::size_t > hits{0};
+		std::atomic< std::size_t > saved_bytes{0};
+
+
+	private:
+		/// \brief Forget a file that is replaced, requires the mutex
+		void erase(std::string const& filename){
+			auto const iter = keys_.find(filename);
+			if(iter == keys_.end()) return;
+
+			auto const files = files_.find(iter->second);
+			files->second.erase(filename);
+			if(files->second.empty()) files_.erase(files);
+			keys_.erase(iter);
+		}
+
+
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		std::set< std::string > busy_;
+		std::map< key, std::set< std::string > > files_;
+		std::map< std::string, key > keys_;
+	};
+
+
+	/// \brief Index of all written files, one tab separated line per file
+	class manifest{
+	public:
+		manifest(std::string filename)
+			: filename_(std::move(filename))
+		{
+			filesystem::create_directories(
+				filesystem::path(filename_).remove_filename());
+
+			os_.open(filename_.c_str(), std::ios::out | std::ios::binary);
+			verify_open(os_, filename_);
+
+			os_ << "# id\tsubid\ti\tj\tfile\toffset\tsize\ttime_in_ms\n";
+			verify_write(os_, filename_);
+		}
+
+		manifest(manifest const&) = delete;
+
+
+		/// \brief Add the location of a written file
+		///
+		/// i and j are empty if the payload has no such dimension, offset is
+		/// the position in the file (an archive or the file itself).
+		void append(
+			job const& job,
+			std::string const& file,
+			std::size_t offset,
+			std::size_t size
+		){
+			using namespace std::chrono;
+			auto const time = duration_cast< milliseconds >(
+				system_clock::now().time_since_epoch()).count();
+
+			std::ostringstream line;
+			line << job.id << '\t' << job.subid << '\t';
+			if(job.i) line << *job.i;
+			line << '\t';
+			if(job.j) line << *job.j;
+			line << '\t' << file << '\t' << offset << '\t' << size << '\t'
+				<< time << '\n';
+
+			std::lock_guard< std::mutex > lock(mutex_);
+			os_ << line.str();
+			verify_write(os_, filename_);
+		}
+
+
+	private:
+		std::string const filename_;
+
+		std::mutex mutex_;
+		std::ofstream os_;
+	};
+
+
 	struct state{
+		/// \brief Maximal count of queued files per io_uring batch
+		static constexpr std::size_t max_batch = 64;
+
+		state(
+			std::string date_time,
+			durability mode,
+			compression codec,
+			std::optional< int > level,
+			std::unique_ptr< group_commit > group,
+			std::unique_ptr< tar_archive > archive,
+			std::unique_ptr< flight_recorder > recorder,
+			std::unique_ptr< deduplicator > dedup,
+			std::unique_ptr< manifest > index,
+			std::unique_ptr< io_uring > ring,
+			std::size_t async_threads,
+			std::size_t queue_size,
+			overflow_policy policy
+		)
+			: date_time(std::move(date_time))
+			, mode(mode)
+			, codec(codec)
+			, level(level)
+			, group(std::move(group))
+			, archive(std::move(archive))
+			, recorder(std::move(recorder))
+			, dedup(std::move(dedup))
+			, index(std::move(index))
+			, ring(std::move(ring))
+			, queue(async_threads == 0 ? nullptr
+				: this->ring ? std::make_unique< async_queue< job > >(
+					async_threads, queue_size, policy, max_batch,
+					[this](std::vector< job >& jobs){
+						logsys::log([&jobs](logsys::stdlogb& os){
+								os << "save async io_uring write "
+									<< jobs.size() << " files";
+							}, [this, &jobs]{
+								write(jobs);
+							});
+					})
+				: std::make_unique< async_queue< job > >(
+					async_threads, queue_size, policy,
+					[this](job& job){
+						logsys::log([&job](logsys::stdlogb& os){
+								os << "save async write " << job.filename;
+							}, [this, &job]{
+								write(job);
+							});
+					})) {}
+
+		state(state const&) = delete;
+
+		~state(){
+			if(!queue) return;
+
+			queue->flush();
+			logsys::exception_catching_log([this](logsys::stdlogb& os){
+					os << "save async writer shutdown (dropped "
+						<< queue->dropped() << " files, "
+						<< queue->errors() << " write errors)";
+				}, [this]{
+					queue->rethrow_error();
+				});
+		}
+
+		/// \brief Compress and write, called by the writer threads
+		void write(job& job){
+			if(archive){
+				compress(job);
+				auto const [file, offset] = archive->write(job);
+				if(index) index->append(job, file, offset, job.data.size());
+				return;
+			}
+
+			create_directories(job.filename);
+
+			// no other thread writes the file until it is indexed
+			std::optional< deduplicator::file_lock > lock;
+			if(dedup) lock.emplace(*dedup, job.filename);
+
+			auto fd = dedup ? write_deduplicated(job) : write_file(job);
+			sync(std::move(fd), job.filename);
+
+			if(index){
+				// a deduplicated job still holds the uncompressed data
+				index->append(job, job.filename, 0, dedup
+					? filesystem::file_size(job.filename) : job.data.size());
+			}
+		}
+
+		/// \brief Write many files by io_uring, requires ring
+		void write(std::vector< job >& jobs){
+			for(auto& job: jobs){
+				compress(job);
+				create_directories(job.filename);
+			}
+
+			auto fds = [this, &jobs]{
+					std::lock_guard< std::mutex > lock(ring_mutex);
+					return save::write(*ring, jobs, mode != durability::none);
+				}();
+
+			for(std::size_t i = 0; i < jobs.size(); ++i){
+				sync(std::move(fds[i]), jobs[i].filename);
+				if(index){
+					index->append(jobs[i], jobs[i].filename, 0,
+						jobs[i].data.size());
+				}
+			}
+		}
+
+		void sync(file_descriptor&& fd, std::string const& filename){
+			switch(mode){
+				case durability::none:
+				break;
+				case durability::group:
+					group->add(std::move(fd), filename);
+				break;
+				case durability::per_file:
+					sync_file(fd.get(), filename);
+					sync_directory(filesystem::path(filename)
+						.parent_path().string());
+				break;
+			}
+		}
+
+		void compress(job& job)const{
+			if(codec == compression::none) return;
+			job.data = disposer_module::compress(codec, level, job.data);
+		}
+
+		file_descriptor write_file(job& job)const{
+			compress(job);
+			return save::write(job);
+		}
+
+		/// \brief Hardlink to an earlier file with the same content
+		///
+		/// Files are always replaced instead of overwritten, because an
+		/// overwrite would change all hardlinks to the file too.
+		file_descriptor write_deduplicated(job& job){
+			auto const key = deduplicator::make_key(job.data);
+			if(dedup->replace(key, job.filename)){
+				dedup->count(true, key.second);
+				return sync_fd(job.filename);
+			}
+
+			auto fd = write_file(job);
+			dedup->insert(key, job.filename);
+			dedup->count(false, 0);
+			return fd;
+		}
+
+		file_descriptor sync_fd(std::string const& filename)const{
+			if(mode == durability::none) return {};
+			return open_for_sync(filename);
+		}
+
+		/// \brief Create the parent directories once per module instance
+		void create_directories(std::string const& filename){
+			auto path = filesystem::path(filename).remove_filename();
+
+			std::lock_guard< std::mutex > lock(directories_mutex);
+			if(directories.count(path.string()) > 0) return;
+
+			filesystem::create_directories(path);
+			directories.insert(path.string());
+		}
+
 		std::string const date_time;
+		durability const mode;
+		compression const codec;
+		std::optional< int > const level;
+
+		std::mutex directories_mutex;
+		std::set< std::string > directories;
+
+		// commits outstanding files after all writes are done
+		std::unique_ptr< group_commit > const group;
+
+		// the queue writes into the archive, so it must be destroyed first
+		std::unique_ptr< tar_archive > const archive;
+		std::unique_ptr< flight_recorder > const recorder;
+		std::unique_ptr< deduplicator > const dedup;
+		std::unique_ptr< manifest > const index;
+
+		std::mutex ring_mutex;
+		std::unique_ptr< io_uring > const ring;
+
+		std::unique_ptr< async_queue< job > > const queue;
 	};
 
 
+	template < typename Module >
+	void write_parallel(
+		Module const& module,
+		state& state,
+		std::vector< job >& jobs
+	){
+		auto const write_threads = module("write_threads"_param);
+		if(write_threads == 1 || jobs.size() < 2){
+			for(auto& job: jobs){
+				module.log([&job](logsys::stdlogb& os){
+						os << job.filename;
+					}, [&state, &job]{
+						state.write(job);
+					});
+			}
+			return;
+		}
+
+		// an exception must not leave a pool thread, collect the failures
+		std::mutex mutex;
+		std::vector< std::string > failed;
+		thread_pool pool(write_threads);
+		pool(0, jobs.size(), [&](std::size_t i){
+				auto& job = jobs[i];
+				auto const success = module.exception_catching_log(
+					[&job](logsys::stdlogb& os){
+						os << job.filename;
+					}, [&state, &job]{
+						state.write(job);
+					});
+
+				if(!success){
+					std::lock_guard< std::mutex > lock(mutex);
+					failed.push_back(job.filename);
+				}
+			});
+
+		if(!failed.empty()){
+			throw std::runtime_error(std::to_string(failed.size()) + " of "
+				+ std::to_string(jobs.size()) + " files could not be "
+				"written: " + io_tools::range_to_string(failed));
+		}
+	}
+
+
 	void init(std::string const& name, declarant& disposer){
 		auto init = generate_module(
 			"save binary data to hard disk, the filenames are generated by "
@@ -223,6 +1218,142 @@ namespace disposer_module::save{
 				make("subid_add"_param, free_type_c< std::size_t >,
 					"value is added to sub ID",
 					default_value(0)),
+				make("write_threads"_param, free_type_c< std::size_t >,
+					"count of threads that write the files of one exec "
+					"concurrently if async_threads is 0, the files of "
+					"vector payloads are written in parallel then, errors are "
+					"collected and reported together",
+					default_value(1),
+					verify_value_fn([](std::size_t value){
+						if(value == 0){
+							throw std::logic_error("must be greater 0");
+						}
+					})),
+				make("backend"_param, free_type_c< write_backend >,
+					"how single files are written:\n"
+					"* posix => open, write and close every file on its own\n"
+					"* io_uring => submit the opens, preallocations, writes "
+					"and closes of all files of an exec, or of up to 64 "
+					"queued files, as batches, write_threads is not used "
+					"then; does not apply to archive and deduplicate, falls "
+					"back to posix if the kernel does not support io_uring",
+					parser_fn([](std::string_view data){
+						return parse_enum< write_backend >(
+							data, write_backend_list);
+					}),
+					default_value(write_backend::posix)),
+				make("async_threads"_param, free_type_c< std::size_t >,
+					"count of background threads that write the files, with "
+					"0 the files are written synchronously in exec, "
+					"otherwise write errors are reported by the next exec",
+					default_value(0)),
+				make("queue_size"_param, free_type_c< std::size_t >,
+					"maximal count of files waiting for a background thread",
+					default_value(64),
+					verify_value_fn([](std::size_t value){
+						if(value == 0){
+							throw std::logic_error("must be greater 0");
+						}
+					})),
+				make("overflow"_param, free_type_c< overflow_policy >,
+					"behavior if the queue is full:\n"
+					"* block => exec waits until a file was written\n"
+					"* drop_newest => the new file is not saved\n"
+					"* drop_oldest => the oldest queued file is not saved",
+					parser_fn([](std::string_view data){
+						return parse_enum< overflow_policy >(
+							data, overflow_policy_list);
+					}),
+					default_value(overflow_policy::block)),
+				make("durability"_param, free_type_c< durability >,
+					"when written files are synced to the disk:\n"
+					"* none => left to the operating system\n"
+					"* group => fdatasync of the files and fsync of their "
+					"directories in batches, see group_files and "
+					"group_interval_in_ms; an archive is synced with its "
+					"directory when it is closed at roll or module end\n"
+					"* per_file => fdatasync of every file and fsync of its "
+					"directory before the write counts as done; for "
+					"archives after every member",
+					parser_fn([](std::string_view data){
+						return parse_enum< durability >(
+							data, durability_list);
+					}),
+					default_value(durability::none)),
+				make("group_files"_param, free_type_c< std::size_t >,
+					"durability group commits after this count of files",
+					default_value(64),
+					verify_value_fn([](std::size_t value){
+						if(value == 0){
+							throw std::logic_error("must be greater 0");
+						}
+					})),
+				make("group_interval_in_ms"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"durability group additionally commits periodically "
+					"with this interval if set"),
+				make("compression"_param, free_type_c< compression >,
+					"codec to compress every file with before it is written, "
+					"compression runs in the writer threads (see write_threads "
+					"and async_threads), the file names are not changed:\n"
+					"* none => write the data unchanged\n"
+					"* lz4 => LZ4 frame format, fast\n"
+					"* zstd => Zstandard frame format, better ratio",
+					parser_fn([](std::string_view data){
+						return parse_enum< compression >(
+							data, compression_list);
+					}),
+					default_value(compression::none)),
+				make("compression_level"_param,
+					free_type_c< std::optional< int > >,
+					"codec specific compression level, the codec default (lz4 "
+					"0, zstd 3) if not set"),
+				make("deduplicate"_param, free_type_c< bool >,
+					"files with the same content (compared by xxHash64 and "
+					"size) as an earlier written file are created as "
+					"hardlink to it instead of being written again, hit rate "
+					"and saved bytes are logged, does not apply to archives",
+					default_value(false)),
+				make("manifest"_param, free_type_c< std::string >,
+					"if not empty, a line with ID, sub ID, i, j, file, "
+					"offset, size and time (milliseconds since epoch) is "
+					"appended to this tab separated file for every written "
+					"file, file and offset are the archive and the position "
+					"in it if parameter archive is used, module "
+					"load_manifest reads files by this index\n"
+					"you can use ${date_time} as in parameter name",
+					default_value("")),
+				make("archive"_param, free_type_c< std::string >,
+					"if not empty, the files are appended as members to tar "
+					"archives instead of being written as single files, the "
+					"member names are generated by parameter name\n"
+					"pattern to generate the archive file names, you can use "
+					"some variables via ${variable}\n"
+					"* ${archive} is the number of the archive, it is "
+					"incremented when an archive is full\n"
+					"* ${date_time} is the same as in parameter name",
+					default_value("")),
+				make("archive_max_members"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"start a new archive after this count of members"),
+				make("archive_max_bytes"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"start a new archive before it grows beyond this size"),
+				make("recorder_frames"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"flight recorder mode if one of the recorder parameters is "
+					"set: the files of the latest execs are kept in memory and "
+					"only written when input trigger is true, this is the "
+					"maximal count of kept execs"),
+				make("recorder_seconds"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"flight recorder keeps the execs of this last seconds"),
+				make("recorder_max_bytes"_param,
+					free_type_c< std::optional< std::size_t > >,
+					"flight recorder keeps at most this many bytes of data"),
+				make("trigger"_in, free_type_c< bool >,
+					"in flight recorder mode all kept files are written if "
+					"a value is true, including the files of this exec"),
 				make("content"_in, type_ref_c< 0 >,
 					"the data to be saved"),
 				make("i_digits"_param, wrapped_type_ref_c< i_type, 0 >,
@@ -310,26 +1441,179 @@ namespace disposer_module::save{
 				)
 			),
 			module_init_fn([](auto const module){
-				state s{io_tools::time_to_dir_string()};
+				auto date_time = io_tools::time_to_dir_string();
+
+				auto const mode = module("durability"_param);
+
+				std::unique_ptr< tar_archive > archive;
+				auto const archive_name = module("archive"_param);
+				if(!archive_name.empty()){
+					archive = std::make_unique< tar_archive >(
+						make_name_generator(
+							archive_name,
+							{false, true},
+							std::make_pair("date_time"s, nothing{}),
+							std::make_pair("archive"s, format{4, 0})
+						),
+						date_time,
+						mode,
+						module("archive_max_members"_param),
+						module("archive_max_bytes"_param));
+				}
+
+				// archives are synced by themselves
+				std::unique_ptr< group_commit > group;
+				if(mode == durability::group && !archive){
+					std::optional< std::chrono::milliseconds > interval;
+					auto const value = module("group_interval_in_ms"_param);
+					if(value) interval = std::chrono::milliseconds(*value);
+
+					group = std::make_unique< group_commit >(
+						module("group_files"_param), interval);
+				}
+
+				std::unique_ptr< flight_recorder > recorder;
+				auto const recorder_frames = module("recorder_frames"_param);
+				auto const recorder_seconds = module("recorder_seconds"_param);
+				auto const recorder_max_bytes =
+					module("recorder_max_bytes"_param);
+				if(recorder_frames || recorder_seconds || recorder_max_bytes){
+					std::optional< std::chrono::seconds > max_age;
+					if(recorder_seconds){
+						max_age = std::chrono::seconds(*recorder_seconds);
+					}
+
+					recorder = std::make_unique< flight_recorder >(
+						recorder_frames, max_age, recorder_max_bytes);
+				}
+
+				std::unique_ptr< deduplicator > dedup;
+				if(module("deduplicate"_param) && archive_name.empty()){
+					dedup = std::make_unique< deduplicator >();
+				}
+
+				std::unique_ptr< manifest > index;
+				auto const manifest_name = module("manifest"_param);
+				if(!manifest_name.empty()){
+					index = std::make_unique< manifest >(
+						make_name_generator(
+							manifest_name,
+							{false},
+							std::make_pair("date_time"s, nothing{})
+						)(date_time));
+				}
+
+				std::unique_ptr< io_uring > ring;
+				if(
+					module("backend"_param) == write_backend::io_uring &&
+					archive_name.empty() && !module("deduplicate"_param)
+				){
+					module.exception_catching_log(
+						[](logsys::stdlogb& os){
+							os << "create io_uring, use posix on failure";
+						}, [&ring]{
+							ring = std::make_unique< io_uring >();
+						});
+				}
+
+				auto s = std::make_unique< state >(
+					std::move(date_time),
+					mode,
+					module("compression"_param),
+					module("compression_level"_param),
+					std::move(group),
+					std::move(archive),
+					std::move(recorder),
+					std::move(dedup),
+					std::move(index),
+					std::move(ring),
+					module("async_threads"_param),
+					module("queue_size"_param),
+					module("overflow"_param));
 				module.log([&s](logsys::stdlogb& os){
-						os << "variable date_time is: " << s.date_time;
+						os << "variable date_time is: " << s->date_time;
 					});
 				return s;
 			}),
 			exec_fn([](auto module){
+				auto& state = *module.state();
+
+				// report write errors of previous execs
+				if(state.queue) state.queue->rethrow_error();
+
+				std::vector< job > jobs;
 				std::size_t subid = 0;
-				for(auto const& img: module("content"_in).references()){
+				for(auto&& img: module("content"_in).values()){
 					auto const fixed_id = module("fixed_id"_param);
 					auto id = fixed_id ? *fixed_id : module.id();
 
 					auto const id_modulo = module("id_modulo"_param);
 					if(id_modulo) id %= *id_modulo;
 
-					save(module, module.state().date_time, id, subid,
-						module("name"_param), img);
+					add_jobs(jobs, state.date_time, id, subid,
+						module("name"_param), std::move(img));
 
 					++subid;
 				}
+
+				if(state.recorder){
+					auto& recorder = *state.recorder;
+					recorder.add(std::move(jobs));
+
+					bool triggered = false;
+					for(auto const value: module("trigger"_in).values()){
+						triggered = triggered || value;
+					}
+
+					if(!triggered){
+						auto const size = recorder.size();
+						module.log([size](logsys::stdlogb& os){
+								os << "flight recorder holds " << size.first
+									<< " execs (" << size.second << " bytes)";
+							});
+						return;
+					}
+
+					jobs = recorder.take();
+					module.log([&jobs](logsys::stdlogb& os){
+							os << "flight recorder triggered, write "
+								<< jobs.size() << " files";
+						});
+				}
+
+				if(state.queue){
+					auto& queue = *state.queue;
+					auto const count = jobs.size();
+					for(auto& job: jobs){
+						queue.push(std::move(job));
+					}
+
+					module.log([&queue, count](logsys::stdlogb& os){
+							os << "queued " << count << " files (queue depth "
+								<< queue.size() << ", dropped "
+								<< queue.dropped() << ")";
+						});
+				}else if(state.ring){
+					module.log([&jobs](logsys::stdlogb& os){
+							os << "io_uring write " << jobs.size() << " files";
+						}, [&state, &jobs]{
+							state.write(jobs);
+						});
+				}else{
+					write_parallel(module, state, jobs);
+				}
+
+				if(state.dedup){
+					auto const files = state.dedup->files.load();
+					auto const hits = state.dedup->hits.load();
+					auto const saved_bytes = state.dedup->saved_bytes.load();
+					module.log([files, hits, saved_bytes](logsys::stdlogb& os){
+							os << "deduplicated " << hits << " of " << files
+								<< " files (hit rate "
+								<< (files > 0 ? 100. * hits / files : 0.)
+								<< " %), saved " << saved_bytes << " bytes";
+						});
+				}
 			})
 		);
 
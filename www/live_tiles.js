@@ -0,0 +1,95 @@
+// Decoder for the bitmap tiles of the http_server websocket module
+//
+// Message layout, little endian: u8 type (0 keyframe, 1 delta),
+// u8 channels (1 gray, 3 RGB), u16 tile size, u32 width, u32 height,
+// u32 tile count, then for every tile u32 column, u32 row and its pixels
+// row by row. Tiles at the right and bottom border are smaller.
+//
+// Usage:
+//
+//     let decoder = new LiveTilesDecoder(canvas);
+//     socket.binaryType = "arraybuffer";
+//     socket.onopen = function(){ socket.send("ready"); };
+//     socket.onmessage = function(event){
+//         decoder.decode(event.data);
+//         socket.send("ready");
+//     };
+//
+// After the text message 'deflate' pass the message through
+// LiveTilesDecoder.inflate(event.data) first.
+"use strict";
+
+function LiveTilesDecoder(canvas){
+	this.canvas = canvas;
+	this.context = canvas.getContext("2d");
+	this.image = null;
+}
+
+// Messages of deflate sessions start with 0 for raw data and 1 for zlib
+LiveTilesDecoder.inflate = function(buffer){
+	let bytes = new Uint8Array(buffer);
+	if(bytes[0] === 0){
+		return Promise.resolve(buffer.slice(1));
+	}
+
+	let stream = new Blob([bytes.subarray(1)]).stream()
+		.pipeThrough(new DecompressionStream("deflate"));
+	return new Response(stream).arrayBuffer();
+};
+
+// Returns false for a delta before the first keyframe
+LiveTilesDecoder.prototype.decode = function(buffer){
+	let view = new DataView(buffer);
+	let type = view.getUint8(0);
+	let channels = view.getUint8(1);
+	let tileSize = view.getUint16(2, true);
+	let width = view.getUint32(4, true);
+	let height = view.getUint32(8, true);
+	let count = view.getUint32(12, true);
+
+	if(type === 0){
+		if(
+			!this.image ||
+			this.image.width !== width ||
+			this.image.height !== height
+		){
+			this.canvas.width = width;
+			this.canvas.height = height;
+			this.image = this.context.createImageData(width, height);
+		}
+	}else if(!this.image){
+		return false;
+	}
+
+	let pixels = new Uint8Array(buffer);
+	let rgba = this.image.data;
+	let pos = 16;
+	for(let i = 0; i < count; ++i){
+		let x0 = view.getUint32(pos, true) * tileSize;
+		let y0 = view.getUint32(pos + 4, true) * tileSize;
+		pos += 8;
+
+		let w = Math.min(tileSize, width - x0);
+		let h = Math.min(tileSize, height - y0);
+		for(let y = y0; y < y0 + h; ++y){
+			let target = (y * width + x0) * 4;
+			for(let x = 0; x < w; ++x){
+				if(channels === 3){
+					rgba[target] = pixels[pos];
+					rgba[target + 1] = pixels[pos + 1];
+					rgba[target + 2] = pixels[pos + 2];
+				}else{
+					rgba[target] = pixels[pos];
+					rgba[target + 1] = pixels[pos];
+					rgba[target + 2] = pixels[pos];
+				}
+				rgba[target + 3] = 255;
+				target += 4;
+				pos += channels;
+			}
+		}
+	}
+
+	this.context.putImageData(this.image, 0, 0);
+	return true;
+};